@@ -0,0 +1,594 @@
+#include <pthread.h>
+
+#include <stdlib.h>
+
+#include "board.h"
+#include "placement.h"
+
+#define ROW_BITS 16
+#define ROW_MASK 0xFFFFULL
+#define ROW_COUNT (1 << ROW_BITS)
+
+typedef struct {
+    /*  Per row width: the row after moving it left/right and the score gained doing so.  */
+    uint16_t left[BOARD_MAX_SIZE + 1][ROW_COUNT];
+    uint16_t right[BOARD_MAX_SIZE + 1][ROW_COUNT];
+    uint32_t scoreLeft[BOARD_MAX_SIZE + 1][ROW_COUNT];
+    uint32_t scoreRight[BOARD_MAX_SIZE + 1][ROW_COUNT];
+    /*  Per row width: the row with its cells in reverse order.  */
+    uint16_t reverse[BOARD_MAX_SIZE + 1][ROW_COUNT];
+    /*  Per row width: whether moving the row would join two blocks at BOARD_MAX_EXPONENT. Since blocks only join
+     *  their neighbours once the empty cells are gone, this is the same for both directions.  */
+    uint8_t overflow[BOARD_MAX_SIZE + 1][ROW_COUNT];
+} RowTables;
+
+/*  The tables are read by every move of every thread, so each NUMA node gets its own copy on huge pages. Every
+ *  thread binds its node's copy once with initBoardTables(), so moves read the thread's pointer without checking
+ *  it first.  */
+static ReplicatedTable replicatedTables;
+static const RowTables *builtTables;
+static __thread const RowTables *threadTables = NULL;
+
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Slides and joins a single row of <i>width</i> exponents to the left, the same way moveFieldLeft() does.
+ * @param row Row exponents, modified in place.
+ * @param width Number of cells in the row.
+ * @return Score gained by the joins.
+ */
+static uint32_t slideRow(int *row, int width) {
+    int out[BOARD_MAX_SIZE] = {0};
+    int count = 0;
+    int last = 0;
+    uint32_t gained = 0;
+
+    for (int i = 0; i < width; i++) {
+        int value = row[i];
+        if (value == 0)
+            continue;
+
+        // Joins at most once per block; blocks at the cap can't grow any further.
+        if (value == last && value < BOARD_MAX_EXPONENT) {
+            out[count - 1] = value + 1;
+            gained += 1u << (value + 1);
+            last = 0;
+        } else {
+            out[count++] = value;
+            last = value;
+        }
+    }
+
+    for (int i = 0; i < width; i++)
+        row[i] = out[i];
+
+    return gained;
+}
+
+static int rowOverflows(const int *row, int width) {
+    int last = 0;
+    for (int i = 0; i < width; i++) {
+        if (row[i] == 0)
+            continue;
+        if (row[i] == BOARD_MAX_EXPONENT && last == BOARD_MAX_EXPONENT)
+            return true;
+        last = row[i];
+    }
+    return false;
+}
+
+static uint16_t packRow(const int *row, int width) {
+    uint16_t packed = 0;
+    for (int i = 0; i < width; i++)
+        packed |= (uint16_t) (row[i] << (4 * i));
+    return packed;
+}
+
+static void unpackRow(uint16_t packed, int *row, int width) {
+    for (int i = 0; i < width; i++)
+        row[i] = (packed >> (4 * i)) & 0xF;
+}
+
+static void fillTables(RowTables *tables) {
+    for (int width = 2; width <= BOARD_MAX_SIZE; width++) {
+        int rows = 1 << (4 * width);
+
+        for (int r = 0; r < rows; r++) {
+            int row[BOARD_MAX_SIZE];
+            int reversed[BOARD_MAX_SIZE];
+
+            unpackRow((uint16_t) r, row, width);
+            for (int i = 0; i < width; i++)
+                reversed[i] = row[width - 1 - i];
+            tables->reverse[width][r] = packRow(reversed, width);
+            tables->overflow[width][r] = (uint8_t) rowOverflows(row, width);
+
+            tables->scoreLeft[width][r] = slideRow(row, width);
+            tables->left[width][r] = packRow(row, width);
+
+            tables->scoreRight[width][r] = slideRow(reversed, width);
+            int back[BOARD_MAX_SIZE];
+            for (int i = 0; i < width; i++)
+                back[i] = reversed[width - 1 - i];
+            tables->right[width][r] = packRow(back, width);
+        }
+    }
+}
+
+static void buildTables() {
+    RowTables *tables = calloc(1, sizeof(RowTables));
+    if (tables == NULL) {
+        perror("nc2048: row tables");
+        exit(1);
+    }
+    fillTables(tables);
+
+    // Without any copy the tables stay where they were built.
+    if (replicateTable(&replicatedTables, "row tables", tables, sizeof(RowTables)) == 0) {
+        free(tables);
+        tables = NULL;
+    }
+    builtTables = tables;
+}
+
+#define rowTables() (threadTables)
+
+/**
+ * Builds the row lookup tables used by the packed board functions and binds the calling thread to the copy on
+ * its NUMA node. Every thread that uses the packed board must call it first. Safe to call more than once and from
+ * multiple threads, the tables are only built on the first call.
+ */
+void initBoardTables() {
+    pthread_once(&tablesOnce, buildTables);
+    threadTables = (builtTables != NULL) ? builtTables : localReplica(&replicatedTables);
+}
+
+/**
+ * Packs a field into a board. Exponents above BOARD_MAX_EXPONENT are clamped.
+ * @param _field
+ * @return The packed board.
+ */
+Board boardFromField(Field _field) {
+    Board board = 0;
+    for (int i = 0; i < SIZE; i++) {
+        for (int j = 0; j < SIZE; j++) {
+            int value = _field[i][j];
+            if (value > BOARD_MAX_EXPONENT)
+                value = BOARD_MAX_EXPONENT;
+            board |= (Board) value << boardShift(i, j);
+        }
+    }
+    return board;
+}
+
+/**
+ * Unpacks a board into a field.
+ * @param board
+ * @param _field
+ */
+void boardToField(Board board, Field _field) {
+    for (int i = 0; i < SIZE; i++)
+        for (int j = 0; j < SIZE; j++)
+            _field[i][j] = boardCell(board, i, j);
+}
+
+/**
+ * Transposes the board along its main diagonal. Works for every board size, since smaller boards are kept
+ * in the top-left corner.
+ * @param board
+ * @return The transposed board.
+ */
+Board boardTranspose(Board board) {
+    Board a1 = board & 0xF0F00F0FF0F00F0FULL;
+    Board a2 = board & 0x0000F0F00000F0F0ULL;
+    Board a3 = board & 0x0F0F00000F0F0000ULL;
+    Board a = a1 | (a2 << 12) | (a3 >> 12);
+    Board b1 = a & 0xFF00FF0000FF00FFULL;
+    Board b2 = a & 0x00FF00FF00000000ULL;
+    Board b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+/**
+ * Applies a row table to the first <i>size</i> rows of the board.
+ */
+static Board applyRows(Board board, int size, const uint16_t *rows, const uint32_t *scores, int *gained) {
+    Board out = 0;
+    int total = 0;
+
+    for (int y = 0; y < size; y++) {
+        int row = (int) ((board >> (ROW_BITS * y)) & ROW_MASK);
+        out |= (Board) rows[row] << (ROW_BITS * y);
+        total += (int) scores[row];
+    }
+
+    if (gained != NULL)
+        *gained = total;
+    return out;
+}
+
+/**
+ * Moves and joins the blocks of a <i>size</i> x <i>size</i> board in direction <i>dir</i>.
+ * initBoardTables() must have been called before.
+ * @param board
+ * @param dir One of the DIR_* values.
+ * @param size Board side length, 2 to BOARD_MAX_SIZE.
+ * @param gained Receives the score gained by the move, may be NULL.
+ * @return The moved board. Equal to <i>board</i> if nothing could move.
+ */
+Board boardMoveSized(Board board, int dir, int size, int *gained) {
+    const RowTables *tables = rowTables();
+
+    switch (dir) {
+        case DIR_LEFT:
+            return applyRows(board, size, tables->left[size], tables->scoreLeft[size], gained);
+        case DIR_RIGHT:
+            return applyRows(board, size, tables->right[size], tables->scoreRight[size], gained);
+        case DIR_UP:
+            return boardTranspose(
+                    applyRows(boardTranspose(board), size, tables->left[size], tables->scoreLeft[size], gained));
+        case DIR_DOWN:
+            return boardTranspose(
+                    applyRows(boardTranspose(board), size, tables->right[size], tables->scoreRight[size], gained));
+        default:
+            if (gained != NULL)
+                *gained = 0;
+            return board;
+    }
+}
+
+/**
+ * Checks whether moving the board would join two blocks at BOARD_MAX_EXPONENT, which the packed board can't
+ * hold. boardMoveSized() leaves such blocks apart instead.
+ * @param board
+ * @param dir
+ * @param size
+ * @return true(1) if the move needs wider cells, false(0) otherwise.
+ */
+int boardMoveOverflows(Board board, int dir, int size) {
+    // Nibbles with all 4 bits set. Without two of them there is nothing to check.
+    Board capped = board & (board >> 1) & (board >> 2) & (board >> 3) & 0x1111111111111111ULL;
+    if (__builtin_popcountll(capped) < 2)
+        return false;
+
+    const RowTables *tables = rowTables();
+    if (dir == DIR_UP || dir == DIR_DOWN)
+        board = boardTranspose(board);
+    for (int y = 0; y < size; y++)
+        if (tables->overflow[size][(board >> (ROW_BITS * y)) & ROW_MASK])
+            return true;
+    return false;
+}
+
+/**
+ * Counts the empty cells of a <i>size</i> x <i>size</i> board.
+ * @param board
+ * @param size
+ * @return Number of empty cells.
+ */
+int boardEmptyCount(Board board, int size) {
+    // Low bit of every nibble that is in use on this board size.
+    static const Board activeMask[BOARD_MAX_SIZE + 1] = {
+            0,
+            0x0000000000000001ULL,
+            0x0000000000110011ULL,
+            0x0000011101110111ULL,
+            0x1111111111111111ULL
+    };
+
+    Board occupied = board | (board >> 2);
+    occupied |= occupied >> 1;
+    return __builtin_popcountll(~occupied & activeMask[size]);
+}
+
+/**
+ * Checks whether any move changes a <i>size</i> x <i>size</i> board.
+ * @param board
+ * @param size
+ * @return true(1) if the board can be moved, false(0) if the game is over.
+ */
+int boardIsMovable(Board board, int size) {
+    for (int dir = 0; dir < DIR_COUNT; dir++)
+        if (boardMoveSized(board, dir, size, NULL) != board)
+            return true;
+    return false;
+}
+
+/**
+ * Populates a random empty cell of the board, with the same odds as populateRandomBlock(). Unlike that one,
+ * it picks among the empty cells directly instead of retrying random coordinates.
+ * @param board
+ * @param size
+ * @param rng Random number stream to draw from.
+ * @return The board with the new block, unchanged if it was full.
+ */
+Board boardSpawn(Board board, int size, Rng *rng) {
+    int empty = boardEmptyCount(board, size);
+    if (empty == 0)
+        return board;
+
+    int target = rngInt(rng, empty - 1);
+    Board value = (rngInt(rng, SPAWN_FOUR_ODDS) == 0) ? 2 : 1;
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (boardCell(board, y, x) != 0)
+                continue;
+            if (target-- == 0)
+                return board | (value << boardShift(y, x));
+        }
+    }
+    return board;
+}
+
+/**
+ * Creates the board a new game starts with, like initField().
+ * @param size
+ * @param rng
+ * @return
+ */
+Board boardNew(int size, Rng *rng) {
+    return boardSpawn(boardSpawn(0, size, rng), size, rng);
+}
+
+/**
+ * @param board
+ * @return The highest block exponent on the board.
+ */
+int boardMaxExponent(Board board) {
+    int max = 0;
+    while (board != 0) {
+        int value = (int) (board & 0xF);
+        if (value > max)
+            max = value;
+        board >>= 4;
+    }
+    return max;
+}
+
+/**
+ * @param board
+ * @return Sum of all block values on the board. Grows by exactly 2 or 4 with every move + spawn.
+ */
+int boardTileSum(Board board) {
+    int sum = 0;
+    while (board != 0) {
+        int value = (int) (board & 0xF);
+        if (value != 0)
+            sum += 1 << value;
+        board >>= 4;
+    }
+    return sum;
+}
+
+/**
+ * Mirrors a <i>size</i> x <i>size</i> board left to right.
+ * @param board
+ * @param size
+ * @return The mirrored board.
+ */
+Board boardMirror(Board board, int size) {
+    const RowTables *tables = rowTables();
+    Board out = 0;
+    for (int y = 0; y < size; y++) {
+        int row = (int) ((board >> (ROW_BITS * y)) & ROW_MASK);
+        out |= (Board) tables->reverse[size][row] << (ROW_BITS * y);
+    }
+    return out;
+}
+
+/*
+ * The 8 symmetries are built from mirroring (1) and transposing (2). Each entry lists the operations in the
+ * order they are applied, terminated by 0.
+ */
+static const int symmetryOps[SYMMETRY_COUNT][4] = {
+        {0},
+        {1, 0},
+        {2, 0},
+        {2, 1, 0},
+        {1, 2, 0},
+        {1, 2, 1, 0},
+        {2, 1, 2, 0},
+        {2, 1, 2, 1}
+};
+
+/**
+ * Applies symmetry <i>symmetry</i> (0 to SYMMETRY_COUNT - 1) to the board.
+ * @param board
+ * @param size
+ * @param symmetry
+ * @return The transformed board.
+ */
+Board boardSymmetry(Board board, int size, int symmetry) {
+    for (int i = 0; i < 4 && symmetryOps[symmetry][i] != 0; i++)
+        board = (symmetryOps[symmetry][i] == 1) ? boardMirror(board, size) : boardTranspose(board);
+    return board;
+}
+
+/**
+ * Maps a direction through a symmetry: moving <i>board</i> in direction <i>dir</i> corresponds to moving
+ * boardSymmetry(board, size, symmetry) in direction dirSymmetry(dir, symmetry).
+ * @param dir
+ * @param symmetry
+ * @return The transformed direction.
+ */
+int dirSymmetry(int dir, int symmetry) {
+    static const int mirrored[DIR_COUNT] = {DIR_RIGHT, DIR_LEFT, DIR_UP, DIR_DOWN};
+    static const int transposed[DIR_COUNT] = {DIR_UP, DIR_DOWN, DIR_LEFT, DIR_RIGHT};
+
+    for (int i = 0; i < 4 && symmetryOps[symmetry][i] != 0; i++)
+        dir = (symmetryOps[symmetry][i] == 1) ? mirrored[dir] : transposed[dir];
+    return dir;
+}
+
+/**
+ * Finds the canonical representative of a board: the smallest of its symmetric variants.
+ * @param board
+ * @param size
+ * @param symmetry Receives the symmetry that maps <i>board</i> to the result, may be NULL.
+ * @return The canonical board.
+ */
+Board boardCanonical(Board board, int size, int *symmetry) {
+    Board best = board;
+    int bestSymmetry = 0;
+
+    for (int i = 1; i < SYMMETRY_COUNT; i++) {
+        Board candidate = boardSymmetry(board, size, i);
+        if (candidate < best) {
+            best = candidate;
+            bestSymmetry = i;
+        }
+    }
+
+    if (symmetry != NULL)
+        *symmetry = bestSymmetry;
+    return best;
+}
+
+/**
+ * Starts a wide board from a packed one.
+ * @param wide
+ * @param board
+ */
+void wideBoardInit(WideBoard *wide, Board board) {
+    wide->board = board;
+    wide->wide = false;
+}
+
+/**
+ * Slides and joins a line of wide cells towards its first cell. Same rules as slideRow(), without the cap.
+ * @param line Pointers to the cells, in the order they slide.
+ * @param width
+ * @param changed Set to true(1) if any cell changed.
+ * @return Score gained by the joins.
+ */
+static uint64_t slideWideLine(uint8_t **line, int width, int *changed) {
+    uint8_t out[BOARD_MAX_SIZE] = {0};
+    int count = 0;
+    int last = 0;
+    uint64_t gained = 0;
+
+    for (int i = 0; i < width; i++) {
+        int value = *line[i];
+        if (value == 0)
+            continue;
+
+        if (value == last) {
+            out[count - 1] = (uint8_t) (value + 1);
+            gained += 1ULL << (value + 1);
+            last = 0;
+        } else {
+            out[count++] = (uint8_t) value;
+            last = value;
+        }
+    }
+
+    for (int i = 0; i < width; i++) {
+        if (*line[i] != out[i])
+            *changed = true;
+        *line[i] = out[i];
+    }
+    return gained;
+}
+
+/**
+ * Moves and joins the blocks of a wide board. Stays on the packed board (and its row tables) until a move would
+ * join two blocks at BOARD_MAX_EXPONENT, and moves the exact exponents from then on.
+ * @param wide
+ * @param dir One of the DIR_* values.
+ * @param size Board side length, 2 to BOARD_MAX_SIZE.
+ * @param gained Receives the score gained by the move, may be NULL.
+ * @return true(1) if the board changed, false(0) otherwise.
+ */
+int wideBoardMove(WideBoard *wide, int dir, int size, uint64_t *gained) {
+    if (wide->wide == false) {
+        if (boardMoveOverflows(wide->board, dir, size) == false) {
+            int points;
+            Board moved = boardMoveSized(wide->board, dir, size, &points);
+            if (gained != NULL)
+                *gained = (uint64_t) points;
+            if (moved == wide->board)
+                return false;
+            wide->board = moved;
+            return true;
+        }
+
+        for (int y = 0; y < BOARD_MAX_SIZE; y++)
+            for (int x = 0; x < BOARD_MAX_SIZE; x++)
+                wide->cells[y][x] = (uint8_t) boardCell(wide->board, y, x);
+        wide->wide = true;
+    }
+
+    int forward = (dir == DIR_LEFT || dir == DIR_UP);
+    int horizontal = (dir == DIR_LEFT || dir == DIR_RIGHT);
+    int changed = false;
+    uint64_t total = 0;
+
+    if (dir >= 0 && dir < DIR_COUNT) {
+        for (int i = 0; i < size; i++) {
+            uint8_t *line[BOARD_MAX_SIZE];
+            for (int j = 0; j < size; j++) {
+                int k = forward ? j : size - 1 - j;
+                line[j] = horizontal ? &wide->cells[i][k] : &wide->cells[k][i];
+            }
+            total += slideWideLine(line, size, &changed);
+        }
+    }
+
+    Board board = 0;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int value = wide->cells[y][x];
+            board |= (Board) ((value > BOARD_MAX_EXPONENT) ? BOARD_MAX_EXPONENT : value) << boardShift(y, x);
+        }
+    }
+    wide->board = board;
+
+    if (gained != NULL)
+        *gained = total;
+    return changed;
+}
+
+/**
+ * Populates a random empty cell of a wide board, drawing exactly like boardSpawn().
+ * @param wide
+ * @param size
+ * @param rng
+ */
+void wideBoardSpawn(WideBoard *wide, int size, Rng *rng) {
+    Board spawned = boardSpawn(wide->board, size, rng);
+
+    // Empty cells are the same on the clamped board, so the new block is the only difference.
+    if (wide->wide == true && spawned != wide->board) {
+        Board added = spawned ^ wide->board;
+        int shift = __builtin_ctzll(added) & ~3;
+        wide->cells[shift / ROW_BITS][(shift % ROW_BITS) / 4] = (uint8_t) ((added >> shift) & 0xF);
+    }
+    wide->board = spawned;
+}
+
+/**
+ * @param wide
+ * @param size
+ * @return The highest block exponent on the board, including blocks past BOARD_MAX_EXPONENT.
+ */
+int wideBoardMaxExponent(const WideBoard *wide, int size) {
+    if (wide->wide == false)
+        return boardMaxExponent(wide->board);
+
+    int max = 0;
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+            if (wide->cells[y][x] > max)
+                max = wide->cells[y][x];
+    return max;
+}
+
+/**
+ * @param dir
+ * @return Human readable name of a direction.
+ */
+const char *dirName(int dir) {
+    static const char *names[DIR_COUNT] = {"LEFT", "RIGHT", "UP", "DOWN"};
+    return (dir >= 0 && dir < DIR_COUNT) ? names[dir] : "NONE";
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+
+#include "global.h"
+#include "field.h"
+#include "random.h"
+
+#ifndef NC2048_BOARD_H
+#define NC2048_BOARD_H
+
+#if SIZE > 4
+#error "The packed board only supports fields of up to 4x4 blocks."
+#endif
+
+/*  A field packed into 64 bits. Every cell holds the 4-bit block exponent (same values as Field),
+ *  cells are stored row-major with 4 cells (16 bits) per row. Boards smaller than 4x4 occupy the
+ *  top-left corner, all other cells stay 0.  */
+typedef uint64_t Board;
+
+/*  Largest supported board side length.  */
+#define BOARD_MAX_SIZE 4
+/*  Largest block exponent a packed cell can hold. (15 -> 2^15 = 32768)  */
+#define BOARD_MAX_EXPONENT 15
+
+/*  Move directions, used as indices wherever a value is kept per direction.  */
+#define DIR_LEFT 0
+#define DIR_RIGHT 1
+#define DIR_UP 2
+#define DIR_DOWN 3
+#define DIR_COUNT 4
+#define DIR_NONE (-1)
+
+/*  Number of board symmetries (rotations and reflections of a square board).  */
+#define SYMMETRY_COUNT 8
+
+/*  A board whose blocks may grow past BOARD_MAX_EXPONENT, for games that go on for millions of moves. Until a
+ *  move joins two blocks at the cap only <i>board</i> is used. From then on <i>cells</i> holds the exact
+ *  exponents and <i>board</i> a copy clamped to BOARD_MAX_EXPONENT, which the AI keeps working on.  */
+typedef struct {
+    Board board;
+    int wide;
+    uint8_t cells[BOARD_MAX_SIZE][BOARD_MAX_SIZE];
+} WideBoard;
+
+#define boardShift(y, x) (4 * ((y) * BOARD_MAX_SIZE + (x)))
+#define boardCell(board, y, x) ((int) (((board) >> boardShift(y, x)) & 0xF))
+
+extern void initBoardTables();
+
+extern Board boardFromField(Field _field);
+
+extern void boardToField(Board board, Field _field);
+
+extern Board boardMoveSized(Board board, int dir, int size, int *gained);
+
+#define boardMove(board, dir, gained) boardMoveSized(board, dir, SIZE, gained)
+
+extern int boardMoveOverflows(Board board, int dir, int size);
+
+extern int boardEmptyCount(Board board, int size);
+
+extern int boardIsMovable(Board board, int size);
+
+extern Board boardSpawn(Board board, int size, Rng *rng);
+
+extern Board boardNew(int size, Rng *rng);
+
+extern int boardMaxExponent(Board board);
+
+extern int boardTileSum(Board board);
+
+extern Board boardTranspose(Board board);
+
+extern Board boardMirror(Board board, int size);
+
+extern Board boardSymmetry(Board board, int size, int symmetry);
+
+extern int dirSymmetry(int dir, int symmetry);
+
+extern Board boardCanonical(Board board, int size, int *symmetry);
+
+extern void wideBoardInit(WideBoard *wide, Board board);
+
+extern int wideBoardMove(WideBoard *wide, int dir, int size, uint64_t *gained);
+
+extern void wideBoardSpawn(WideBoard *wide, int size, Rng *rng);
+
+extern int wideBoardMaxExponent(const WideBoard *wide, int size);
+
+extern const char *dirName(int dir);
+
+#endif //NC2048_BOARD_H
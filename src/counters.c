@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "counters.h"
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((PERF_COUNT_HW_CACHE_OP_ ## op) << 8) | ((PERF_COUNT_HW_CACHE_RESULT_ ## result) << 16))
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[COUNTER_COUNT] = {
+        {"cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"L1d misses",    PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, READ, MISS)},
+        {"LLC misses",    PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, READ, MISS)},
+        {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+/**
+ * Opens the hardware counters of the calling thread. They only count between startCounters() and
+ * stopCounters(), and only on this thread.
+ *
+ * The events are opened as one group led by the cycle counter, so the kernel always schedules them together.
+ * Counted on their own, multiplexing would count each event over different stretches of time, and ratios like
+ * the IPC would mix unrelated samples.
+ * @param counters
+ * @return Number of events that can be counted, 0 if counters aren't available here.
+ */
+int openCounters(Counters *counters) {
+    counters->available = 0;
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        counters->fds[i] = -1;
+
+    // The leader is opened first, the members join its group.
+    for (int i = COUNTER_CYCLES; i < COUNTER_COUNT; i++) {
+        int leader = counters->fds[COUNTER_CYCLES];
+        struct perf_event_attr attr;
+
+        if (i != COUNTER_CYCLES && leader < 0)
+            break;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = (i == COUNTER_CYCLES);      /*  Members follow their leader.  */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, (i == COUNTER_CYCLES) ? -1 : leader, 0);
+        if (counters->fds[i] >= 0)
+            counters->available++;
+    }
+    return counters->available;
+}
+
+/**
+ * Zeroes the counters and starts counting.
+ * @param counters
+ */
+void startCounters(Counters *counters) {
+    int leader = counters->fds[COUNTER_CYCLES];
+
+    if (leader < 0)
+        return;
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/**
+ * Stops counting and reads what was counted since startCounters().
+ * @param counters
+ * @param values Receives the counts. Events that couldn't be read are marked invalid.
+ */
+void stopCounters(Counters *counters, CounterValues *values) {
+    int leader = counters->fds[COUNTER_CYCLES];
+    uint64_t data[3 + COUNTER_COUNT];   /*  events, time enabled, time running, then one value per event  */
+
+    memset(values, 0, sizeof(CounterValues));
+    values->threads = 1;
+    if (leader < 0)
+        return;
+
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    ssize_t length = read(leader, data, sizeof(data));
+    if (length < (ssize_t) (3 * sizeof(uint64_t)) || data[0] != (uint64_t) counters->available || data[2] == 0)
+        return;
+
+    // Values come in the order the events joined the group, the leader first.
+    double scale = (double) data[1] / (double) data[2];
+    for (int i = 0, next = 3; i < COUNTER_COUNT; i++) {
+        if (counters->fds[i] < 0)
+            continue;
+        values->values[i] = (double) data[next++] * scale;
+        values->valid[i] = true;
+    }
+}
+
+/**
+ * @param counters
+ */
+void closeCounters(Counters *counters) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0)
+            close(counters->fds[i]);
+        counters->fds[i] = -1;
+    }
+    counters->available = 0;
+}
+
+/**
+ * Adds up the counts of several threads. Events are only reported if every thread could read them.
+ * @param into
+ * @param from
+ */
+void addCounterValues(CounterValues *into, const CounterValues *from) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        into->values[i] += from->values[i];
+        into->valid[i] += from->valid[i];
+    }
+    into->threads += from->threads;
+}
+
+static int isValid(const CounterValues *values, int event) {
+    return values->threads > 0 && values->valid[event] == values->threads;
+}
+
+/**
+ * Writes the counts per unit of work, e.g. "312.5 cycles, 801.0 instructions (IPC 2.56), ... per move".
+ * @param out
+ * @param values
+ * @param units Units of work done while counting.
+ * @param unit Name of a unit of work.
+ */
+void writeCounters(FILE *out, const CounterValues *values, double units, const char *unit) {
+    int written = 0;
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (isValid(values, i) == false)
+            continue;
+        fprintf(out, "%s%.1f %s", (written++ > 0) ? ", " : "", values->values[i] / units, events[i].name);
+        if (i == COUNTER_INSTRUCTIONS && isValid(values, COUNTER_CYCLES) && values->values[COUNTER_CYCLES] > 0)
+            fprintf(out, " (IPC %.2f)", values->values[i] / values->values[COUNTER_CYCLES]);
+    }
+
+    if (written == 0)
+        fprintf(out, "no hardware counters available");
+    else
+        fprintf(out, " per %s", unit);
+}
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef NC2048_COUNTERS_H
+#define NC2048_COUNTERS_H
+
+/*  Hardware events read through perf_event_open(2), used as indices into Counters and CounterValues.  */
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_L1D_MISSES 2
+#define COUNTER_LLC_MISSES 3
+#define COUNTER_BRANCH_MISSES 4
+#define COUNTER_COUNT 5
+
+/*  Counters of the calling thread, user space only, counted as one group. Events the CPU, the hypervisor or
+ *  perf_event_paranoid don't allow are left out; without the cycle counter, which leads the group, the counters
+ *  are simply not available.  */
+typedef struct {
+    int fds[COUNTER_COUNT];     /*  -1 for events that couldn't be opened.  */
+    int available;
+} Counters;
+
+/*  Counts of one or more threads, see addCounterValues(). Zeroed it holds no thread yet.  */
+typedef struct {
+    double values[COUNTER_COUNT];   /*  Scaled up when the kernel had to multiplex the counters.  */
+    int valid[COUNTER_COUNT];       /*  Threads that could read the event.  */
+    int threads;
+} CounterValues;
+
+extern int openCounters(Counters *counters);
+
+extern void startCounters(Counters *counters);
+
+extern void stopCounters(Counters *counters, CounterValues *values);
+
+extern void closeCounters(Counters *counters);
+
+extern void addCounterValues(CounterValues *into, const CounterValues *from);
+
+extern void writeCounters(FILE *out, const CounterValues *values, double units, const char *unit);
+
+#endif //NC2048_COUNTERS_H
@@ -1,3 +1,6 @@
+#include <stdint.h>
+#include <stdio.h>
+
 #include "field.h"
 #include "score.h"
 #include "random.h"
@@ -277,7 +280,7 @@ void populateRandomBlock(Field _field) {
         randY = randFieldCoordinate();
     } while (_field[randY][randX] != 0);
 
-    int rand = randInt(10);
+    int rand = randInt(SPAWN_FOUR_ODDS);
     _field[randY][randX] = (rand == 0) ? 2 : 1;
 }
 
@@ -297,8 +300,8 @@ void moveBlock(int *block1, int *block2) {
  * @param power
  * @return value of base raised to power(base ^ power)
  */
-int power(int base, int power) {
-    int out = 1;
+uint64_t power(uint64_t base, int power) {
+    uint64_t out = 1;
     while (power > 0) {
         out *= base;
         power--;
@@ -315,7 +318,7 @@ void joinBlocks(int *block1, int *block2) {
     *block2 += 1;
     *block1 = 0;
 
-    int block2Val = power(2, *block2);
+    uint64_t block2Val = power(2, *block2);
     updateScore(block2Val);
 }
 
@@ -355,4 +358,47 @@ int isFieldMovable(Field _field) {
 
     return false;
 #undef FIELD_MAX
-}
\ No newline at end of file
+}
+
+/**
+ * Returns a uniform-length character array representing a block on the field.
+ *  All values are of length 7 -> 6 varying chars and string terminator. Values from 16384 on are shortened
+ *  with a k, M, G.. suffix, so blocks up to 2^63 fit.
+ *
+ *  Values are only formatted once to decrease execution time.
+ * @param blockValue Holds block value.
+ * @return A character array representing the block's value. Must not be freed.
+ */
+const char *displayBlock(int blockValue) {
+    /*  Space for 6 chars + string terminator */
+#define MAX_STR_LEN 7
+#define BLANK "[    ]"
+    static char blocks[DISPLAY_MAX_EXPONENT + 1][MAX_STR_LEN];
+
+    if (blockValue <= 0 || blockValue > DISPLAY_MAX_EXPONENT)
+        return BLANK;
+
+    char *str = blocks[blockValue];
+    if (str[0] == 0) {
+        static const char suffixes[] = " kMGTPE";
+        uint64_t value = 1ULL << blockValue;
+        int suffix = 0;
+
+        if (value >= 10000) {
+            while (value >= 1000) {
+                value /= 1024;
+                suffix++;
+            }
+        }
+
+        /*  The modulo changes nothing (value has at most 4 and 3 digits here), but lets the compiler see that the
+         *  text fits.  */
+        if (suffix == 0)
+            snprintf(str, MAX_STR_LEN, "[%4u]", (unsigned) (value % 10000));
+        else
+            snprintf(str, MAX_STR_LEN, "[%3u%c]", (unsigned) (value % 1000), suffixes[suffix]);
+    }
+    return str;
+#undef MAX_STR_LEN
+#undef BLANK
+}
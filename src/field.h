@@ -5,6 +5,9 @@
 
 typedef int Field[SIZE][SIZE];
 
+/*  Highest block exponent displayBlock() can show. (63 -> 2^63)  */
+#define DISPLAY_MAX_EXPONENT 63
+
 void initField(Field _field);
 
 extern void moveBlock(int *block1, int *block2);
@@ -25,4 +28,6 @@ extern void populateRandomBlock(Field _field);
 
 int isFieldMovable(Field _field);
 
+extern const char *displayBlock(int blockValue);
+
 #endif //NC2048_FIELD_H
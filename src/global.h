@@ -5,9 +5,11 @@
 
 /*  Defines the size of the playing field matrix (SIZE * SIZE)  */
 #define SIZE 4
-/* Defines the highest value a block can have. (11 -> 2^11 = 2048)*/
+/* Defines the block value that wins the game. (11 -> 2^11 = 2048) In endless mode blocks grow past it. */
 #define MAX_BLOCK_SIZE 11
 #define MAX_BLOCK_VALUE 2048
+/* A spawned block is a 4 with a chance of 1 in (SPAWN_FOUR_ODDS + 1), a 2 otherwise. */
+#define SPAWN_FOUR_ODDS 10
 
 #define true 1
 #define false 0
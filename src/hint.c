@@ -0,0 +1,128 @@
+#include <pthread.h>
+
+#include "hint.h"
+
+/*
+ * The hint engine searches the current board on a worker thread while the player is thinking. Every
+ * completed depth is published, so the latest hint can be read at any time without searching.
+ *
+ * A new board bumps the generation. The worker's search polls the generation and drops out as soon as it
+ * changes, then starts over on the new board.
+ */
+
+static pthread_t worker;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+
+static int running = false;
+static unsigned generation = 0;
+static Board pendingBoard = 0;
+static Hint published;
+
+static void *runHintEngine(void *arg) {
+    Search search;
+    (void) arg;
+
+    if (initSearch(&search, SEARCH_TABLE_BITS) != 0)
+        return NULL;
+
+    unsigned searched = 0;
+    search.generation = &generation;
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (running && generation == searched)
+            pthread_cond_wait(&changed, &lock);
+        if (!running)
+            break;
+
+        Board board = pendingBoard;
+        searched = generation;
+        pthread_mutex_unlock(&lock);
+
+        search.expected = searched;
+        search.cancelled = false;
+
+        for (int depth = 1; depth <= SEARCH_MAX_DEPTH; depth++) {
+            SearchResult result;
+            if (searchBoard(&search, board, depth, &result) == false)
+                break;
+
+            pthread_mutex_lock(&lock);
+            if (generation == searched) {
+                published.board = board;
+                published.result = result;
+            }
+            pthread_mutex_unlock(&lock);
+
+            if (result.move == DIR_NONE)
+                break;
+        }
+
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    freeSearch(&search);
+    return NULL;
+}
+
+/**
+ * Starts the hint worker thread. It idles until updateHintBoard() is called.
+ * @return 0 on success, -1 if the thread could not be created.
+ */
+int startHintEngine() {
+    running = true;
+    published.board = 0;
+    published.result.move = DIR_NONE;
+
+    if (pthread_create(&worker, NULL, runHintEngine, NULL) != 0) {
+        running = false;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stops the hint worker thread and waits for it to exit.
+ */
+void stopHintEngine() {
+    if (!running)
+        return;
+
+    pthread_mutex_lock(&lock);
+    running = false;
+    __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&changed);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(worker, NULL);
+}
+
+/**
+ * Cancels the running search, if any, and starts searching <i>board</i>. Doesn't wait for the worker.
+ * @param board
+ */
+void updateHintBoard(Board board) {
+    pthread_mutex_lock(&lock);
+    if (board != pendingBoard) {
+        pendingBoard = board;
+        __atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+        pthread_cond_signal(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Copies the latest published hint.
+ * @param board Board the caller wants a hint for.
+ * @param hint Receives the hint.
+ * @return true(1) if a hint for <i>board</i> is available, false(0) otherwise.
+ */
+int readHint(Board board, Hint *hint) {
+    pthread_mutex_lock(&lock);
+    *hint = published;
+    pthread_mutex_unlock(&lock);
+
+    return hint->board == board && hint->result.move != DIR_NONE;
+}
@@ -0,0 +1,20 @@
+#include "board.h"
+#include "search.h"
+
+#ifndef NC2048_HINT_H
+#define NC2048_HINT_H
+
+typedef struct {
+    Board board;            /*  Board the hint was searched for.  */
+    SearchResult result;
+} Hint;
+
+extern int startHintEngine();
+
+extern void stopHintEngine();
+
+extern void updateHintBoard(Board board);
+
+extern int readHint(Board board, Hint *hint);
+
+#endif //NC2048_HINT_H
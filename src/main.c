@@ -1,18 +1,30 @@
 #include <stdlib.h>
 #include <ncurses.h>
 #include <memory.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 /*  Local header files  */
 #include "global.h"
 #include "score.h"
 #include "field.h"
 #include "random.h"
+#include "tablebase.h"
+#include "hint.h"
+#include "recorder.h"
 
 /*  Arrow key char codes:   */
 #define ARROW_DOWN 2
 #define ARROW_UP 3
 #define ARROW_LEFT 4
 #define ARROW_RIGHT 5
+/*  Plays the hinted move.  */
+#define HINT_KEY 'h'
+/*  How often the search hint line is refreshed while waiting for input.  */
+#define HINT_REFRESH_MS 100
+/*  Longest time recorded frames wait in memory, so a killed session loses at most this much of its recording.  */
+#define RECORDING_FLUSH_SECONDS 5.0
 
 #define LOGO_POS_X 6
 #define WIN_WINDOW_ID 0
@@ -21,6 +33,19 @@
 WINDOW *fieldWindow;
 WINDOW *scoreWindow;
 Field field;
+/*  Optional tablebase for the perfect hint, NULL when not loaded.  */
+Tablebase *tablebase = NULL;
+/*  Whether the background hint engine is running.  */
+int hintEngine = false;
+/*  Whether the game goes on after reaching MAX_BLOCK_VALUE.  */
+int endless = false;
+/*  Whether MAX_BLOCK_VALUE was reached in the current endless game.  */
+int won = false;
+/*  Optional asciicast recording of the session.  */
+Recorder recorder;
+int recording = false;
+struct timespec recordingStart;
+double lastRecordingFlush = 0;
 
 /**
  *
@@ -40,16 +65,6 @@ void handleInput(int charCode);
  */
 void drawField(Field _field);
 
-/**
- * Returns a uniform-length character array representing a block on the field.
- *  All values are of length 7 -> 6 varying chars and string terminator.
- *
- *  Values are hardcoded to decrease execution time.
- * @param blockValue Holds block value.
- * @return A character array representing the block's value.
- */
-char *displayBlock(int blockValue);
-
 /**
  * Creates a new WINDOW with provided values.
  * @param height Height of the new window
@@ -71,9 +86,60 @@ void destroyWindow(WINDOW *window);
  */
 void stop();
 
-int main() {
+/**
+ * Draws the hint for the current field on the line above the debug line.
+ */
+void drawHint();
+
+/**
+ * Draws the latest background search hint, if the hint engine is running.
+ */
+void drawSearchHint();
+
+/**
+ * Shows <i>message</i> in the recording, if the session is recorded.
+ */
+void recordNote(const char *message);
+
+int main(int argc, char **argv) {
+    int option;
+    while ((option = getopt(argc, argv, "t:Her:")) != -1) {
+        switch (option) {
+            case 't':
+                tablebase = openTablebase(optarg);
+                if (tablebase == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                if (tablebase->header->size != SIZE) {
+                    fprintf(stderr, "%s: tablebase is for %ux%u boards, not %dx%d.\n", optarg,
+                            tablebase->header->size, tablebase->header->size, SIZE, SIZE);
+                    return 1;
+                }
+                break;
+            case 'H':
+                hintEngine = true;
+                break;
+            case 'e':
+                endless = true;
+                break;
+            case 'r':
+                if (openRecorder(&recorder, optarg, "nc2048") != 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                recording = true;
+                clock_gettime(CLOCK_MONOTONIC, &recordingStart);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t tablebase] [-H] [-e] [-r recording.cast]\n", argv[0]);
+                return 1;
+        }
+    }
+
     /*  Initialization  */
     initRandom();
+    initBoardTables();
     initField(field);
 
     /*  Setting up ncurses. */
@@ -94,6 +160,13 @@ int main() {
 
     refresh();
 
+    if (hintEngine == true) {
+        if (startHintEngine() != 0)
+            hintEngine = false;
+        else
+            timeout(HINT_REFRESH_MS);   /*  Wake up regularly to show search progress. */
+    }
+
     /*   Setting up the field Window   */
     int fieldWindowHeight = SIZE + 2;
     int fieldWindowWidth = (SIZE * 6) + 5;
@@ -132,7 +205,14 @@ int main() {
     drawField(field);
 
     for (;;) {
-        char in = getch();
+        int key = getch();
+
+        /*  Nothing pressed yet, show what the hint engine found so far. */
+        if (key == ERR) {
+            drawSearchHint();
+            continue;
+        }
+        char in = (char) key;
 
         /*  Exit when q is pressed.*/
         if (in == 'q')
@@ -161,6 +241,81 @@ void drawDebug(char *out) {
 #undef START_Y
 }
 
+/**
+ * @return Seconds since the recording started.
+ */
+double recordingTime() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - recordingStart.tv_sec) + (double) (now.tv_nsec - recordingStart.tv_nsec) / 1e9;
+}
+
+void recordNote(const char *message) {
+    if (recording == true)
+        recordMessage(&recorder, recordingTime(), message);
+}
+
+void drawHint() {
+#define START_Y (LINES-2)
+#define START_X 0
+    if (tablebase == NULL)
+        return;
+
+    TableResult result;
+    move(START_Y, START_X);
+    clrtoeol();
+
+    if (probeTablebase(tablebase, boardFromField(field), &result) == true) {
+        printw("Perfect hint: %s (win %.1f%%, expected score +%.0f)", dirName(result.move),
+               result.win * 100.0, result.score);
+    } else {
+        printw("Perfect hint: position not in tablebase.");
+    }
+
+    refresh();
+#undef START_X
+#undef START_Y
+}
+
+void drawSearchHint() {
+#define START_Y (LINES-3)
+#define START_X 0
+    if (hintEngine == false)
+        return;
+
+    Hint hint;
+    move(START_Y, START_X);
+    clrtoeol();
+
+    if (readHint(boardFromField(field), &hint) == true) {
+        printw("Hint: %s (depth %d, confidence %.0f%%, %llu nodes)", dirName(hint.result.move),
+               hint.result.depth, hint.result.confidence * 100.0, (unsigned long long) hint.result.nodes);
+    } else {
+        printw("Hint: thinking...");
+    }
+
+    refresh();
+#undef START_X
+#undef START_Y
+}
+
+/**
+ * Looks up the hinted move for the current field. Only reads hints that are already available.
+ * @return The arrow key code of the hinted move, 0 if there is no hint.
+ */
+int hintedArrow() {
+    static const int arrows[DIR_COUNT] = {ARROW_LEFT, ARROW_RIGHT, ARROW_UP, ARROW_DOWN};
+    Board board = boardFromField(field);
+    TableResult perfect;
+    Hint hint;
+
+    if (tablebase != NULL && probeTablebase(tablebase, board, &perfect) == true && perfect.move != DIR_NONE)
+        return arrows[perfect.move];
+    if (hintEngine == true && readHint(board, &hint) == true)
+        return arrows[hint.result.move];
+    return 0;
+}
+
 /**
  *  Draws the total score and max block value into the score window
  */
@@ -172,7 +327,7 @@ void drawScore() {
 
     wmove(scoreWindow, 2, 1);
     char ScoreStr[25];
-    snprintf(ScoreStr, 25, "%d", score);
+    snprintf(ScoreStr, 25, "%llu", (unsigned long long) score);
     wprintw(scoreWindow, " %s", ScoreStr);
 
     wmove(scoreWindow, 4, 1);
@@ -180,7 +335,7 @@ void drawScore() {
 
     wmove(scoreWindow, 5, 1);
     char MaxStr[25];
-    snprintf(MaxStr, 25, "%d", maxBlock);
+    snprintf(MaxStr, 25, "%llu", (unsigned long long) maxBlock);
     wprintw(scoreWindow, " %s", MaxStr);
 }
 
@@ -193,18 +348,29 @@ void drawField(Field _field) {
 
     for (int i = 0; i < SIZE; i++) {
         for (int j = 0; j < SIZE; j++) {
-            char *block = displayBlock(_field[i][j]);
-            wprintw(fieldWindow, "%s", block);
+            wprintw(fieldWindow, "%s", displayBlock(_field[i][j]));
 
             if (j != (SIZE - 1))
                 wprintw(fieldWindow, " ");
-
-            free(block);
         }
 
         wmove(fieldWindow, START_Y + (i + 1), START_X);
     }
 
+    drawHint();
+    if (hintEngine == true) {
+        updateHintBoard(boardFromField(_field));
+        drawSearchHint();
+    }
+    if (recording == true) {
+        double now = recordingTime();
+        recordFrame(&recorder, now, _field, score);
+        if (now - lastRecordingFlush >= RECORDING_FLUSH_SECONDS) {
+            flushRecorder(&recorder);
+            lastRecordingFlush = now;
+        }
+    }
+
     refresh();
     wrefresh(fieldWindow);
     wrefresh(scoreWindow);
@@ -215,6 +381,10 @@ void drawField(Field _field) {
 
 void handleInput(int charCode) {
     int moved = 0;
+
+    if (charCode == HINT_KEY)
+        charCode = hintedArrow();
+
     switch (charCode) {
         case ARROW_DOWN:
             drawDebug("Pressed arrow DOWN.");
@@ -238,11 +408,16 @@ void handleInput(int charCode) {
 
     if (moved > 0) {
         /* Handle winning condition - 'Did we make a block of value 2048?'*/
-        if (maxBlock == 2048) {
+        if (maxBlock >= MAX_BLOCK_VALUE && endless == false) {
             handlePopupWindow(WIN_WINDOW_ID);
             drawDebug("Congratulations! You won.");
             return;
         }
+        if (maxBlock >= MAX_BLOCK_VALUE && won == false) {
+            won = true;
+            drawDebug("Congratulations! You won. Keep going..");
+            recordNote("You won. Keep going..");
+        }
 
         populateRandomBlock(field);
 
@@ -284,6 +459,10 @@ void stop() {
     destroyWindow(fieldWindow);
     destroyWindow(scoreWindow);
     endwin();
+    stopHintEngine();
+    closeTablebase(tablebase);
+    if (recording == true && closeRecorder(&recorder) != 0)
+        perror("recording");
     exit(0);
 }
 
@@ -294,6 +473,14 @@ void reset() {
     initField(field);
     score = 0;
     maxBlock = 0;
+    won = false;
+
+    /*  A good moment to write the recording, nobody is waiting for the next frame.  */
+    recordNote("");
+    if (recording == true) {
+        flushRecorder(&recorder);
+        lastRecordingFlush = recordingTime();
+    }
 }
 
 /**
@@ -373,9 +560,11 @@ void handlePopupWindow(int windowId) {
     switch (windowId) {
         case WIN_WINDOW_ID:
             window = drawWin();
+            recordNote("Congratulations! You won.");
             break;
         case LOSS_WINDOW_ID:
             window = drawLoss();
+            recordNote("Oh no... You lost!");
             break;
         default:
             /* Invalid popup window id*/
@@ -383,72 +572,14 @@ void handlePopupWindow(int windowId) {
     }
     refresh();
 
-    /* Wait for input */
+    /* Wait for input, the hint engine's refresh timeout must not close the popup */
+    timeout(-1);
     char c = getch();
+    if (hintEngine == true)
+        timeout(HINT_REFRESH_MS);
 
     /* Close pop-up window */
     destroyWindow(window);
     reset();
     refreshScreen();
 }
-
-char *displayBlock(int blockValue) {
-    /*  Space for 6 chars + string terminator */
-#define MAX_STR_LEN (7 * sizeof(char))
-#define BLANK "[    ]"
-    char *str = (char *) malloc(MAX_STR_LEN);
-
-    if (blockValue == 0) {
-        memcpy(str, BLANK, MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 1) {
-        memcpy(str, "[   2]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 2) {
-        memcpy(str, "[   4]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 3) {
-        memcpy(str, "[   8]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 4) {
-        memcpy(str, "[  16]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 5) {
-        memcpy(str, "[  32]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 6) {
-        memcpy(str, "[  64]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 7) {
-        memcpy(str, "[ 128]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 8) {
-        memcpy(str, "[ 256]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 9) {
-        memcpy(str, "[ 512]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 10) {
-        memcpy(str, "[1024]", MAX_STR_LEN);
-        return str;
-    }
-    if (blockValue == 11) {
-        memcpy(str, "[2048]", MAX_STR_LEN);
-        return str;
-    }
-
-    memcpy(str, BLANK, MAX_STR_LEN);
-    return str;
-#undef MAX_STR_LEN
-#undef BLANK
-}
@@ -0,0 +1,343 @@
+#include <ctype.h>
+#include <endian.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*  Local header files  */
+#include "field.h"
+#include "board.h"
+#include "search.h"
+#include "queue.h"
+#include "placement.h"
+
+/*  Positions handed between the pipeline stages at once.  */
+#define BATCH_SIZE 256
+/*  Batches in flight per worker. Bounds the memory used and makes the reader wait for slow workers.  */
+#define BATCHES_PER_WORKER 4
+#define LINE_LENGTH 256
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+/*
+ * Three stage pipeline:  reader -> N search workers -> writer
+ * The reader parses stdin into batches, the workers search every position of a batch and the writer puts the
+ * batches back into input order before printing them. A fixed pool of batches circulates through the stages:
+ * once every batch is in flight the reader blocks until the writer has printed one.
+ */
+
+typedef struct {
+    uint64_t sequence;
+    size_t count;
+    Board boards[BATCH_SIZE];
+    int valid[BATCH_SIZE];
+    SearchResult results[BATCH_SIZE];
+} Batch;
+
+Queue freeBatches;
+Queue parsedBatches;
+Queue searchedBatches;
+
+int depth = 2;
+int tableBits = 16;
+int binaryInput = false;
+int runningWorkers;
+
+/**
+ * Prints how to use nc2048-batch.
+ * @param name Name the program was started with.
+ */
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-j workers] [-d depth] [-T table bits] [-b]\n"
+            "  Reads positions from stdin and writes one line per position to stdout, in input order:\n"
+            "    <board> <best move> <expected score> <evaluation> <nodes>\n"
+            "  Text input has one position per line, either 16 hex digits holding the block exponents in row-major\n"
+            "  order (\"0010000000000001\") or 16 block values (\"0 2 0 0 ... 2\").\n"
+            "  -b          binary input: little-endian 64-bit packed boards, 4 bits per block exponent\n"
+            "  -j workers  search threads (default: all CPUs)\n"
+            "  -d depth    search depth in moves (default 2)\n"
+            "  -T bits     transposition table size per worker, as a power of two (default 16)\n",
+            name);
+}
+
+/**
+ * Parses one text position.
+ * @param line
+ * @param board Receives the position.
+ * @return true(1) if the line holds a valid position, false(0) otherwise.
+ */
+int parseBoard(const char *line, Board *board) {
+    size_t length = strcspn(line, "\r\n");
+
+    /*  16 hex digits: the block exponents.  */
+    if (length == SIZE * SIZE && strspn(line, "0123456789abcdefABCDEF") == length) {
+        *board = 0;
+        for (int i = 0; i < SIZE * SIZE; i++) {
+            char digit = (char) tolower((unsigned char) line[i]);
+            Board value = (Board) ((digit <= '9') ? digit - '0' : digit - 'a' + 10);
+            *board |= value << boardShift(i / SIZE, i % SIZE);
+        }
+        return true;
+    }
+
+    /*  16 block values, separated by spaces or commas.  */
+    Field _field;
+    const char *cursor = line;
+    for (int i = 0; i < SIZE * SIZE; i++) {
+        char *end;
+        long value = strtol(cursor, &end, 10);
+        if (end == cursor || value < 0 || (value & (value - 1)) != 0 || value == 1)
+            return false;
+
+        _field[i / SIZE][i % SIZE] = (value == 0) ? 0 : __builtin_ctzl((unsigned long) value);
+        cursor = end + strspn(end, " ,\t");
+    }
+
+    /*  Anything after the 16th value is an error, not something to skip.  */
+    if (cursor[strspn(cursor, "\r\n")] != '\0')
+        return false;
+
+    *board = boardFromField(_field);
+    return true;
+}
+
+/**
+ * Writes a board as 16 hex digits.
+ * @param board
+ * @param out At least SIZE * SIZE + 1 chars.
+ */
+void formatBoard(Board board, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SIZE * SIZE; i++)
+        out[i] = digits[boardCell(board, i / SIZE, i % SIZE)];
+    out[SIZE * SIZE] = '\0';
+}
+
+/**
+ * Reads the next text line. A line that doesn't fit into <i>line</i> is skipped up to its end, so it still only
+ * counts as one position.
+ * @param line
+ * @param size
+ * @param overlong Set to true(1) if the line was too long.
+ * @return false(0) at the end of the input.
+ */
+int readLine(char *line, int size, int *overlong) {
+    *overlong = false;
+    if (fgets(line, size, stdin) == NULL)
+        return false;
+    if (strchr(line, '\n') != NULL || feof(stdin))
+        return true;
+
+    *overlong = true;
+    int c;
+    while ((c = getchar()) != EOF && c != '\n');
+    return true;
+}
+
+/**
+ * First stage: fills batches from stdin. Positions that can't be read keep their place in the output as
+ * "invalid", the reason goes to stderr.
+ */
+void *readPositions(void *arg) {
+    char line[LINE_LENGTH];
+    uint64_t sequence = 0;
+    uint64_t lineNumber = 0;
+    int done = false;
+    (void) arg;
+
+    while (!done) {
+        Batch *batch = popQueue(&freeBatches);
+        batch->sequence = sequence++;
+        batch->count = 0;
+
+        while (batch->count < BATCH_SIZE) {
+            Board *board = &batch->boards[batch->count];
+
+            if (binaryInput) {
+                uint64_t packed;
+                size_t bytes = fread(&packed, 1, sizeof(packed), stdin);
+                if (bytes != sizeof(packed)) {
+                    if (bytes > 0)
+                        fprintf(stderr, "nc2048-batch: ignored %zu trailing bytes, not a whole board\n", bytes);
+                    done = true;
+                    break;
+                }
+                *board = le64toh(packed);
+                batch->valid[batch->count] = true;
+            } else {
+                int overlong;
+                if (readLine(line, sizeof(line), &overlong) == false) {
+                    done = true;
+                    break;
+                }
+                lineNumber++;
+
+                batch->valid[batch->count] = (overlong == false) && parseBoard(line, board);
+                if (overlong)
+                    fprintf(stderr, "nc2048-batch: line %llu: longer than %d characters\n",
+                            (unsigned long long) lineNumber, LINE_LENGTH - 2);
+                else if (batch->valid[batch->count] == false)
+                    fprintf(stderr, "nc2048-batch: line %llu: not a position\n", (unsigned long long) lineNumber);
+            }
+            batch->count++;
+        }
+
+        if (batch->count > 0)
+            pushQueue(&parsedBatches, batch);
+        else
+            pushQueue(&freeBatches, batch);
+    }
+
+    closeQueue(&parsedBatches);
+    return NULL;
+}
+
+/**
+ * Second stage: searches every position of a batch.
+ */
+void *searchPositions(void *arg) {
+    Search search;
+    (void) arg;
+
+    if (initSearch(&search, tableBits) != 0) {
+        perror("nc2048-batch");
+        exit(1);
+    }
+
+    Batch *batch;
+    while ((batch = popQueue(&parsedBatches)) != NULL) {
+        // Every position starts from an empty table, so its result doesn't depend on which worker searched it.
+        for (size_t i = 0; i < batch->count; i++) {
+            if (!batch->valid[i])
+                continue;
+            clearSearchTable(&search);
+            searchBoard(&search, batch->boards[i], depth, &batch->results[i]);
+        }
+        pushQueue(&searchedBatches, batch);
+    }
+
+    /*  The last worker to finish ends the output.  */
+    if (__atomic_sub_fetch(&runningWorkers, 1, __ATOMIC_ACQ_REL) == 0)
+        closeQueue(&searchedBatches);
+
+    freeSearch(&search);
+    return NULL;
+}
+
+/**
+ * Third stage: prints the batches in input order.
+ * @param poolSize Number of batches in circulation.
+ * @return Number of positions written.
+ */
+uint64_t writePositions(size_t poolSize, uint64_t *nodes) {
+    Batch **pending = calloc(poolSize, sizeof(Batch *));
+    uint64_t next = 0;
+    uint64_t written = 0;
+    char board[SIZE * SIZE + 1];
+
+    *nodes = 0;
+
+    Batch *batch;
+    while ((batch = popQueue(&searchedBatches)) != NULL) {
+        pending[batch->sequence % poolSize] = batch;
+
+        while ((batch = pending[next % poolSize]) != NULL && batch->sequence == next) {
+            for (size_t i = 0; i < batch->count; i++) {
+                SearchResult *result = &batch->results[i];
+                if (!batch->valid[i]) {
+                    fputs("invalid\n", stdout);
+                    continue;
+                }
+
+                formatBoard(batch->boards[i], board);
+                printf("%s %s %.1f %.1f %llu\n", board, dirName(result->move), result->score, result->value,
+                       (unsigned long long) result->nodes);
+                *nodes += result->nodes;
+            }
+            written += batch->count;
+
+            pending[next % poolSize] = NULL;
+            next++;
+            pushQueue(&freeBatches, batch);
+        }
+    }
+
+    free(pending);
+    return written;
+}
+
+int main(int argc, char **argv) {
+    int workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int option;
+
+    while ((option = getopt(argc, argv, "j:d:T:bh")) != -1) {
+        switch (option) {
+            case 'j':
+                workers = atoi(optarg);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'T':
+                tableBits = atoi(optarg);
+                break;
+            case 'b':
+                binaryInput = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (workers < 1 || depth < 1 || tableBits < 0 || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    initBoardTables();
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    size_t poolSize = (size_t) workers * BATCHES_PER_WORKER;
+    Batch *batches = malloc(poolSize * sizeof(Batch));
+    if (batches == NULL || initQueue(&freeBatches, poolSize) != 0 || initQueue(&parsedBatches, poolSize) != 0
+        || initQueue(&searchedBatches, poolSize) != 0) {
+        perror("nc2048-batch");
+        return 1;
+    }
+    for (size_t i = 0; i < poolSize; i++)
+        pushQueue(&freeBatches, &batches[i]);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t reader;
+    pthread_t searchers[workers];
+    runningWorkers = workers;
+    pthread_create(&reader, NULL, readPositions, NULL);
+    for (int i = 0; i < workers; i++)
+        pthread_create(&searchers[i], NULL, searchPositions, NULL);
+
+    uint64_t nodes;
+    uint64_t positions = writePositions(poolSize, &nodes);
+
+    pthread_join(reader, NULL);
+    for (int i = 0; i < workers; i++)
+        pthread_join(searchers[i], NULL);
+    fflush(stdout);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu positions, %llu nodes in %.2fs (%.0f positions/s)\n", (unsigned long long) positions,
+            (unsigned long long) nodes, seconds, (seconds > 0) ? (double) positions / seconds : 0.0);
+    reportTableMemory(stderr);
+
+    freeQueue(&freeBatches);
+    freeQueue(&parsedBatches);
+    freeQueue(&searchedBatches);
+    free(batches);
+    return 0;
+}
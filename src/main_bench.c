@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*  Local header files  */
+#include "field.h"
+#include "board.h"
+#include "random.h"
+#include "counters.h"
+
+#define DEFAULT_OPERATIONS 10000000
+/*  Positions the operations cycle through. Together with their fields they fit in L2.  */
+#define POSITIONS 4096
+
+/*
+ * Times the hot paths of the game (moveField*, populateRandomBlock and isFieldMovable in field.c) against their
+ * packed board counterparts in board.c, on the same positions taken from random games. Besides the time per
+ * operation it reports hardware counters, if the system allows reading them.
+ */
+
+typedef struct {
+    const char *name;
+    uint64_t (*run)(uint64_t operations);     /*  Returns the operations actually done.  */
+} Benchmark;
+
+Board boards[POSITIONS];
+Field fields[POSITIONS];
+Rng rng;
+/*  Results are summed up here, so the compiler can't drop the work.  */
+volatile uint64_t sink;
+
+/**
+ * Prints how to use nc2048-bench.
+ * @param name Name the program was started with.
+ */
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-n operations] [-s seed] [-c]\n"
+            "  Times moveField*, populateRandomBlock and isFieldMovable against the packed board engine.\n"
+            "  Field operations include copying the position, board operations don't need to.\n"
+            "  -n operations  operations per benchmark (default %d)\n"
+            "  -s seed        seed of the positions (default: time based)\n"
+            "  -c             skip the hardware counters\n",
+            name, DEFAULT_OPERATIONS);
+}
+
+/**
+ * Collects positions from random games, with every stage of a game equally likely.
+ */
+void makePositions() {
+    int count = 0;
+
+    while (count < POSITIONS) {
+        Board board = boardNew(SIZE, &rng);
+        while (count < POSITIONS && boardIsMovable(board, SIZE)) {
+            // Keep half of the positions, so consecutive positions aren't too alike.
+            if (rngInt(&rng, 1) == 0)
+                boards[count++] = board;
+
+            Board moved;
+            do {
+                moved = boardMove(board, rngInt(&rng, DIR_COUNT - 1), NULL);
+            } while (moved == board);
+            board = boardSpawn(moved, SIZE, &rng);
+        }
+    }
+
+    for (int i = 0; i < POSITIONS; i++)
+        boardToField(boards[i], fields[i]);
+}
+
+uint64_t runFieldMoves(uint64_t operations) {
+    static int (*const moves[DIR_COUNT])(Field) = {moveFieldLeft, moveFieldRight, moveFieldUp, moveFieldDown};
+    Field _field;
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < operations; i++) {
+        memcpy(_field, fields[i % POSITIONS], sizeof(Field));
+        sum += (uint64_t) moves[(i / POSITIONS) % DIR_COUNT](_field);
+    }
+    sink += sum;
+    return operations;
+}
+
+uint64_t runBoardMoves(uint64_t operations) {
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < operations; i++)
+        sum += boardMove(boards[i % POSITIONS], (int) ((i / POSITIONS) % DIR_COUNT), NULL);
+    sink += sum;
+    return operations;
+}
+
+uint64_t runFieldSpawns(uint64_t operations) {
+    Field _field;
+    uint64_t sum = 0;
+    uint64_t done = 0;
+
+    for (uint64_t i = 0; i < operations; i++) {
+        int position = (int) (i % POSITIONS);
+        // populateRandomBlock() never returns on a full field.
+        if (boardEmptyCount(boards[position], SIZE) == 0)
+            continue;
+        memcpy(_field, fields[position], sizeof(Field));
+        populateRandomBlock(_field);
+        sum += (uint64_t) _field[0][0];
+        done++;
+    }
+    sink += sum;
+    return done;
+}
+
+uint64_t runBoardSpawns(uint64_t operations) {
+    uint64_t sum = 0;
+    uint64_t done = 0;
+
+    for (uint64_t i = 0; i < operations; i++) {
+        int position = (int) (i % POSITIONS);
+        if (boardEmptyCount(boards[position], SIZE) == 0)
+            continue;
+        sum += boardSpawn(boards[position], SIZE, &rng);
+        done++;
+    }
+    sink += sum;
+    return done;
+}
+
+uint64_t runFieldMovable(uint64_t operations) {
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < operations; i++)
+        sum += (uint64_t) isFieldMovable(fields[i % POSITIONS]);
+    sink += sum;
+    return operations;
+}
+
+uint64_t runBoardMovable(uint64_t operations) {
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < operations; i++)
+        sum += (uint64_t) boardIsMovable(boards[i % POSITIONS], SIZE);
+    sink += sum;
+    return operations;
+}
+
+int main(int argc, char **argv) {
+    static const Benchmark benchmarks[] = {
+            {"moveField*",          runFieldMoves},
+            {"boardMove",           runBoardMoves},
+            {"populateRandomBlock", runFieldSpawns},
+            {"boardSpawn",          runBoardSpawns},
+            {"isFieldMovable",      runFieldMovable},
+            {"boardIsMovable",      runBoardMovable}
+    };
+    uint64_t operations = DEFAULT_OPERATIONS;
+    uint64_t seed = (uint64_t) time(NULL);
+    int useCounters = true;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:s:ch")) != -1) {
+        switch (option) {
+            case 'n':
+                operations = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                useCounters = false;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (operations == 0 || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    initRandom();
+    initBoardTables();
+    seedRng(&rng, seed);
+    makePositions();
+
+    Counters counters;
+    if (useCounters && openCounters(&counters) == 0)
+        fprintf(stderr, "Hardware counters are not available (see /proc/sys/kernel/perf_event_paranoid), "
+                        "reporting time only.\n");
+    if (useCounters == false)
+        counters.available = 0;
+
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        struct timespec start, end;
+        CounterValues values;
+
+        // One untimed round brings the code and the positions into the caches.
+        benchmarks[b].run(POSITIONS);
+
+        if (counters.available > 0)
+            startCounters(&counters);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint64_t done = benchmarks[b].run(operations);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (counters.available > 0)
+            stopCounters(&counters, &values);
+
+        double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (done == 0) {
+            printf("%-20s no positions to work on\n", benchmarks[b].name);
+            continue;
+        }
+        printf("%-20s %8.2f ns/op", benchmarks[b].name, seconds * 1e9 / (double) done);
+        if (counters.available > 0) {
+            printf("  ");
+            writeCounters(stdout, &values, (double) done, "op");
+        }
+        printf("\n");
+    }
+
+    if (counters.available > 0)
+        closeCounters(&counters);
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*  Local header files  */
+#include "field.h"
+#include "board.h"
+#include "policy.h"
+#include "recorder.h"
+
+#define DEFAULT_FPS 10.0
+/*  Pause after the end of every game, in seconds of playback.  */
+#define GAME_OVER_PAUSE 2.0
+#define LINE_LENGTH 256
+#define MESSAGE_LENGTH 64
+
+/*
+ * Turns games into asciicast v2 recordings without a terminal. Frames get evenly spaced timestamps, so the
+ * export runs as fast as the frames can be formatted and written, and the recording plays back at -f frames
+ * per second.
+ */
+
+Recorder recorder;
+double frameTime;
+double frameStep;
+
+/**
+ * Prints how to use nc2048-cast.
+ * @param name Name the program was started with.
+ */
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-o out.cast] [-f fps] [-T title] [-p policy [-s seed] [-n games]]\n"
+            "  Writes games as an asciicast v2 recording, one frame per move.\n"
+            "  Without -p, reads a game archive from stdin: one board per line as 16 hex digits holding the block\n"
+            "  exponents in row-major order (the text format of nc2048-batch), an empty line between games.\n"
+            "  -o file     output file (default: stdout)\n"
+            "  -f fps      playback speed in frames per second (default %g)\n"
+            "  -T title    title of the recording\n"
+            "  -p policy   plays the games with a policy instead, see nc2048-sim\n"
+            "  -s seed     run seed of the played games, same as nc2048-sim (default: time based)\n"
+            "  -n games    number of games to play (default 1)\n",
+            name, DEFAULT_FPS);
+}
+
+/**
+ * Parses one archive line.
+ * @param line
+ * @param board Receives the position.
+ * @return true(1) if the line holds a board, false(0) otherwise.
+ */
+int parseArchiveBoard(const char *line, Board *board) {
+    size_t length = strcspn(line, "\r\n");
+    if (length != SIZE * SIZE || strspn(line, "0123456789abcdefABCDEF") != length)
+        return false;
+
+    *board = 0;
+    for (int i = 0; i < SIZE * SIZE; i++) {
+        char digit = (char) tolower((unsigned char) line[i]);
+        Board value = (Board) ((digit <= '9') ? digit - '0' : digit - 'a' + 10);
+        *board |= value << boardShift(i / SIZE, i % SIZE);
+    }
+    return true;
+}
+
+/**
+ * Finds the move that leads from one archived board to the next, which differ by a move and a spawn.
+ * @param from
+ * @param to
+ * @param gained Receives the score gained by the move, 0 if no move fits.
+ * @return true(1) if a move fits, false(0) otherwise.
+ */
+int findMove(Board from, Board to, int *gained) {
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        Board moved = boardMove(from, dir, gained);
+        Board spawned = to ^ moved;
+
+        // Exactly one cell differs, it was empty and now holds a 2 or a 4.
+        if (moved == from || spawned == 0)
+            continue;
+        int shift = __builtin_ctzll(spawned) & ~3;
+        Board value = spawned >> shift;
+        if ((value == 1 || value == 2) && ((moved >> shift) & 0xF) == 0)
+            return true;
+    }
+    *gained = 0;
+    return false;
+}
+
+void recordBoard(Board board, uint64_t score) {
+    Field _field;
+    boardToField(board, _field);
+    recordFrame(&recorder, frameTime, _field, score);
+    frameTime += frameStep;
+}
+
+void recordGameOver(int game, uint64_t score) {
+    char message[MESSAGE_LENGTH];
+    snprintf(message, sizeof(message), "Game %d over, score %llu.", game, (unsigned long long) score);
+    recordMessage(&recorder, frameTime, message);
+    frameTime += GAME_OVER_PAUSE;
+    recordMessage(&recorder, frameTime, "");
+}
+
+/**
+ * Records an archive from stdin.
+ * @return Number of games recorded.
+ */
+int recordArchive() {
+    char line[LINE_LENGTH];
+    int games = 0;
+    int inGame = false;
+    uint64_t lineNumber = 0;
+    uint64_t score = 0;
+    Board board = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        Board next;
+        int gained = 0;
+        lineNumber++;
+
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            if (inGame)
+                recordGameOver(++games, score);
+            inGame = false;
+            continue;
+        }
+        if (parseArchiveBoard(line, &next) == false) {
+            fprintf(stderr, "Line %llu: not a board, skipped.\n", (unsigned long long) lineNumber);
+            continue;
+        }
+
+        if (inGame == false) {
+            inGame = true;
+            score = 0;
+        } else if (findMove(board, next, &gained) == false) {
+            fprintf(stderr, "Line %llu: no move leads here from the previous board.\n",
+                    (unsigned long long) lineNumber);
+        }
+
+        board = next;
+        score += (uint64_t) gained;
+        recordBoard(board, score);
+    }
+
+    if (inGame)
+        recordGameOver(++games, score);
+    return games;
+}
+
+void observeGame(void *context, const WideBoard *board, uint64_t score) {
+    Field _field;
+    (void) context;
+
+    for (int y = 0; y < SIZE; y++)
+        for (int x = 0; x < SIZE; x++)
+            _field[y][x] = board->wide ? board->cells[y][x] : boardCell(board->board, y, x);
+    recordFrame(&recorder, frameTime, _field, score);
+    frameTime += frameStep;
+}
+
+int main(int argc, char **argv) {
+    const char *outPath = "-";
+    const char *title = NULL;
+    PolicySpec spec;
+    int playing = false;
+    uint64_t runSeed = (uint64_t) time(NULL);
+    int gameCount = 1;
+    double fps = DEFAULT_FPS;
+    int option;
+
+    while ((option = getopt(argc, argv, "o:f:T:p:s:n:h")) != -1) {
+        switch (option) {
+            case 'o':
+                outPath = optarg;
+                break;
+            case 'f':
+                fps = atof(optarg);
+                break;
+            case 'T':
+                title = optarg;
+                break;
+            case 'p':
+                if (parsePolicySpec(optarg, &spec) != 0) {
+                    fprintf(stderr, "Unknown policy '%s'.\n", optarg);
+                    return 1;
+                }
+                playing = true;
+                break;
+            case 's':
+                runSeed = strtoull(optarg, NULL, 10);
+                break;
+            case 'n':
+                gameCount = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (fps <= 0 || gameCount < 1 || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    initBoardTables();
+    if (openRecorder(&recorder, outPath, title) != 0) {
+        perror(outPath);
+        return 1;
+    }
+    frameStep = 1.0 / fps;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int games = 0;
+    if (playing) {
+        Policy policy;
+        if (initPolicy(&policy, &spec, gameSeed(runSeed, (uint64_t) gameCount)) != 0) {
+            perror("nc2048-cast");
+            return 1;
+        }
+        for (games = 0; games < gameCount; games++) {
+            GameResult result;
+            playGameObserved(&policy, gameSeed(runSeed, (uint64_t) games), &result, observeGame, NULL);
+            recordGameOver(games + 1, result.score);
+        }
+        freePolicy(&policy);
+    } else {
+        games = recordArchive();
+    }
+
+    uint64_t frames = recorder.frames;
+    if (closeRecorder(&recorder) != 0) {
+        perror(outPath);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%d games, %llu frames (%.0f s of playback) in %.2fs, %.0f frames/s\n", games,
+            (unsigned long long) frames, frameTime, seconds, frames / seconds);
+    return 0;
+}
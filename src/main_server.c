@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*  Local header files  */
+#include "server.h"
+#include "placement.h"
+
+#define DEFAULT_SOCKET_PATH "/tmp/nc2048.sock"
+
+/**
+ * Prints how to use nc2048-server.
+ * @param name Name the program was started with.
+ */
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-s socket] [-j shards]\n"
+            "  Hosts games for bots on a Unix domain socket until interrupted. See server.h for the protocol.\n"
+            "  -s socket   socket path (default " DEFAULT_SOCKET_PATH ")\n"
+            "  -j shards   event loop threads (default 1)\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    const char *path = DEFAULT_SOCKET_PATH;
+    int shards = 1;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:j:h")) != -1) {
+        switch (option) {
+            case 's':
+                path = optarg;
+                break;
+            case 'j':
+                shards = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    initBoardTables();
+    reportTableMemory(stderr);
+
+    if (runServer(path, shards) != 0) {
+        perror("nc2048-server");
+        return 1;
+    }
+    return 0;
+}
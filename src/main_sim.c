@@ -0,0 +1,510 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*  Local header files  */
+#include "policy.h"
+#include "stats.h"
+#include "placement.h"
+#include "counters.h"
+
+#define DEFAULT_GAMES 1000
+#define DEFAULT_POLICY "search:2"
+#define DEFAULT_ALPHA 0.01
+#define DEFAULT_MIN_PAIRS 200
+#define DEFAULT_LOOKS 10
+#define MAX_LOOKS 64
+/*  How often the main thread checks whether the workers are done.  */
+#define POLL_MS 50
+
+/*
+ * Workers claim games from a shared counter and add them to their own Stats, so no statistics are shared while
+ * the run is going. For progress reports the main thread only reads each worker's counters; the full
+ * statistics are merged once all workers are done.
+ *
+ * In a tournament (-T) every game is played by both policies with the same spawn seed. The paired score
+ * differences are far less noisy than independent games, so fewer games settle which policy is better.
+ *
+ * Looking at the result again and again until it happens to be significant would make false positives far more
+ * likely than alpha. A tournament therefore only tests at a fixed schedule of looks, set by game numbers: look k
+ * uses exactly the games below lookGames[k], once all of them are done, no matter how fast they were played. Each
+ * look is tested at its share of alpha under an O'Brien-Fleming type spending function. The shares add up to
+ * alpha, so the chance of any false positive stays below alpha (Bonferroni bound), and the interval reported at
+ * the deciding look is a matching repeated confidence interval.
+ *
+ * Workers keep their pairs in one PairedStats per look, so a look can be put together from finished games only.
+ * The per-policy summaries ("a", "b") cover every game played, including games that finished after the deciding
+ * look; the report gives both counts.
+ * Each worker guards them with its own lock, which only the main thread contends for.
+ *
+ * With -P every worker counts hardware events (cycles, instructions, cache and branch misses) of its own thread,
+ * which are added up at the end and reported per move and per search node. The counts are only reported if every
+ * worker could count; helper threads of Monte Carlo policies (mc:...:threads) can't, so with those there are none.
+ */
+
+typedef struct {
+    pthread_t thread;
+    Policy policy;
+    Policy opponent;
+    Stats stats;
+    Stats opponentStats;
+
+    pthread_mutex_t pairedLock;
+    PairedStats paired[MAX_LOOKS];      /*  Games from lookGames[k - 1] up to lookGames[k].  */
+    CounterValues counters;
+
+    /*  Read by the main thread while the worker runs.  */
+    uint64_t games;
+    uint64_t moves;
+    uint64_t scoreSum;
+    int done;
+} Worker;
+
+PolicySpec policySpec;
+PolicySpec opponentSpec;
+int tournament = false;
+uint64_t runSeed;
+uint64_t gameCount = DEFAULT_GAMES;
+uint64_t nextGame = 0;
+int stopping = false;
+int countEvents = false;
+
+double alpha = DEFAULT_ALPHA;
+uint64_t minPairs = DEFAULT_MIN_PAIRS;
+int lookCount = DEFAULT_LOOKS;
+uint64_t lookGames[MAX_LOOKS];
+double lookAlpha[MAX_LOOKS];
+/*  Finished games per look, and the next look to test.  */
+uint64_t lookDone[MAX_LOOKS];
+int nextLook = 0;
+
+Stats total;
+Stats opponentTotal;
+PairedStats pairedTotal;
+int decided = false;
+int stoppedEarly = false;
+double seconds;
+
+/**
+ * Prints how to use nc2048-sim.
+ * @param name Name the program was started with.
+ */
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-n games] [-j threads] [-p policy] [-T policy] [-s seed] [-i seconds] [-J report.json]\n"
+            "          [-C report.csv] [-a alpha] [-m pairs] [-k looks] [-P]\n"
+            "  Simulates games and reports the distribution of scores, game lengths and max blocks.\n"
+            "  -n games    number of games, the maximum in a tournament (default %d)\n"
+            "  -j threads  worker threads (default: all CPUs)\n"
+            "  -p policy   random, search[:depth] or mc[:rollouts[:depth[:threads]]] (mcg: guided rollouts)\n"
+            "              (default " DEFAULT_POLICY ")\n"
+            "  -T policy   tournament: play every game with -p and this policy on the same spawn seeds and compare\n"
+            "  -s seed     run seed, the same seed replays the same spawns (default: time based)\n"
+            "  -i seconds  progress interval, 0 to disable (default 1)\n"
+            "  -J file     write the final report as JSON (default: JSON to stdout)\n"
+            "  -C file     write the final report as CSV\n"
+            "  -a alpha    tournament: significance level, stops once the confidence interval excludes 0\n"
+            "              (default %g)\n"
+            "  -m pairs    tournament: games at the first look (default %d)\n"
+            "  -k looks    tournament: looks at the result, evenly spaced from -m to -n games (default %d)\n"
+            "  -P          count hardware events (perf_event_open) and report them per move and search node\n",
+            name, DEFAULT_GAMES, DEFAULT_ALPHA, DEFAULT_MIN_PAIRS, DEFAULT_LOOKS);
+}
+
+double elapsedSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void *runWorker(void *arg) {
+    Worker *worker = arg;
+    Counters counters;
+
+    initBoardTables();
+    if (countEvents && openCounters(&counters) > 0)
+        startCounters(&counters);
+    else
+        counters.available = 0;
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        uint64_t game = __atomic_fetch_add(&nextGame, 1, __ATOMIC_RELAXED);
+        if (game >= gameCount)
+            break;
+
+        uint64_t seed = gameSeed(runSeed, game);
+        GameResult result;
+        playGame(&worker->policy, seed, &result);
+        addGame(&worker->stats, &result);
+
+        if (tournament) {
+            GameResult opponentResult;
+            playGame(&worker->opponent, seed, &opponentResult);
+            addGame(&worker->opponentStats, &opponentResult);
+
+            int look = 0;
+            while (game >= lookGames[look])
+                look++;
+            pthread_mutex_lock(&worker->pairedLock);
+            addPair(&worker->paired[look], (double) result.score, (double) opponentResult.score);
+            pthread_mutex_unlock(&worker->pairedLock);
+            __atomic_add_fetch(&lookDone[look], 1, __ATOMIC_RELEASE);
+
+            result.moves += opponentResult.moves;
+        }
+
+        __atomic_store_n(&worker->moves, worker->moves + result.moves, __ATOMIC_RELAXED);
+        __atomic_store_n(&worker->scoreSum, worker->scoreSum + result.score, __ATOMIC_RELAXED);
+        __atomic_store_n(&worker->games, worker->games + 1, __ATOMIC_RELEASE);
+    }
+
+    if (counters.available > 0) {
+        stopCounters(&counters, &worker->counters);
+        closeCounters(&counters);
+    }
+    __atomic_store_n(&worker->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * Plans the looks of a tournament: the first after <i>minPairs</i> games, the last after all games.
+ */
+void planLooks() {
+    int planned = (gameCount > minPairs) ? lookCount : 1;
+    double spent = 0;
+
+    lookCount = 0;
+    for (int k = 0; k < planned; k++) {
+        uint64_t games = gameCount;
+        if (planned > 1)
+            games = minPairs + (gameCount - minPairs) * (uint64_t) k / (uint64_t) (planned - 1);
+        if (lookCount > 0 && games == lookGames[lookCount - 1])
+            continue;
+
+        double spentNow = spentAlpha(alpha, (double) games / (double) gameCount);
+        lookGames[lookCount] = games;
+        lookAlpha[lookCount] = spentNow - spent;
+        spent = spentNow;
+        lookCount++;
+    }
+}
+
+/**
+ * Merges the pairs of looks 0 to <i>look</i>.
+ */
+void collectPairs(Worker *workers, int threads, int look, PairedStats *paired) {
+    initPairedStats(paired);
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_lock(&workers[i].pairedLock);
+        for (int k = 0; k <= look; k++)
+            mergePairedStats(paired, &workers[i].paired[k]);
+        pthread_mutex_unlock(&workers[i].pairedLock);
+    }
+}
+
+void printProgress(Worker *workers, int threads, double elapsed) {
+    uint64_t games = 0;
+    uint64_t moves = 0;
+    uint64_t scoreSum = 0;
+
+    for (int i = 0; i < threads; i++) {
+        games += __atomic_load_n(&workers[i].games, __ATOMIC_ACQUIRE);
+        moves += __atomic_load_n(&workers[i].moves, __ATOMIC_RELAXED);
+        scoreSum += __atomic_load_n(&workers[i].scoreSum, __ATOMIC_RELAXED);
+    }
+
+    fprintf(stderr, "[%7.1fs] %llu/%llu games, %.1f games/s, %.0f moves/s, mean score %.0f", elapsed,
+            (unsigned long long) games, (unsigned long long) gameCount, games / elapsed, moves / elapsed,
+            (games > 0) ? (double) scoreSum / (double) games : 0.0);
+
+    if (tournament) {
+        PairedStats paired;
+        collectPairs(workers, threads, lookCount - 1, &paired);
+        fprintf(stderr, ", difference %.1f (standard error %.1f), %d/%d looks", paired.mean[2],
+                pairedStandardError(&paired), nextLook, lookCount);
+    }
+    fprintf(stderr, "\n");
+}
+
+/**
+ * Tests every look whose games are all done, in order, until one is significant.
+ * @return true(1) once the tournament is decided, with the deciding look in nextLook.
+ */
+int testLooks(Worker *workers, int threads) {
+    while (nextLook < lookCount) {
+        uint64_t done = 0;
+        for (int k = 0; k <= nextLook; k++)
+            done += __atomic_load_n(&lookDone[k], __ATOMIC_ACQUIRE);
+        if (done < lookGames[nextLook])
+            return false;
+
+        PairedStats paired;
+        collectPairs(workers, threads, nextLook, &paired);
+        if (pairedPValue(&paired) < lookAlpha[nextLook])
+            return true;
+        nextLook++;
+    }
+    return false;
+}
+
+void writeJson(FILE *out) {
+    if (!tournament) {
+        writeStatsJson(out, &total, seconds);
+        return;
+    }
+
+    char policyName[32];
+    char opponentName[32];
+    formatPolicySpec(&policySpec, policyName, sizeof(policyName));
+    formatPolicySpec(&opponentSpec, opponentName, sizeof(opponentName));
+
+    fprintf(out, "{\n\"policy_a\": \"%s\",\n\"policy_b\": \"%s\",\n\"alpha\": %g,\n\"look\": %d,\n\"looks\": %d,\n"
+                 "\"significant\": %s,\n\"stopped_early\": %s,\n", policyName, opponentName, alpha, nextLook + 1,
+            lookCount, decided ? "true" : "false", stoppedEarly ? "true" : "false");
+    /*  "a" and "b" summarize all games played, "paired" only the games up to the deciding look.  */
+    fprintf(out, "\"games_played\": %llu,\n\"games_compared\": %llu,\n\"a\": ", (unsigned long long) total.games,
+            (unsigned long long) pairedTotal.count);
+    writeStatsJson(out, &total, seconds);
+    fprintf(out, ",\n\"b\": ");
+    writeStatsJson(out, &opponentTotal, seconds);
+    fprintf(out, ",\n\"paired\": ");
+    writePairedJson(out, &pairedTotal, lookAlpha[nextLook]);
+    fprintf(out, "}\n");
+}
+
+void writeCsv(FILE *out) {
+    if (tournament) {
+        writePairedCsv(out, &pairedTotal, lookAlpha[nextLook]);
+        fprintf(out, "alpha,%g\nlook,%d\nlooks,%d\nsignificant,%d\nstopped_early,%d\ngames_played,%llu\n", alpha,
+                nextLook + 1, lookCount, decided, stoppedEarly, (unsigned long long) total.games);
+    } else
+        writeStatsCsv(out, &total, seconds);
+}
+
+/**
+ * @param spec
+ * @return true(1) if the policy plays part of its moves on helper threads, which aren't counted.
+ */
+int hasHelperThreads(const PolicySpec *spec) {
+    return spec->type == POLICY_MONTE_CARLO && spec->threads > 1;
+}
+
+/**
+ * Prints the hardware events of all workers per move, and per search node if the policies searched. The moves
+ * and nodes are those of every worker, so the counts are only printed if every worker counted all of its work.
+ */
+void printCounters(const CounterValues *counters, int workers, uint64_t moves, uint64_t nodes) {
+    if (hasHelperThreads(&policySpec) || (tournament && hasHelperThreads(&opponentSpec))) {
+        fprintf(stderr, "counters: not available (Monte Carlo helper threads aren't counted)\n");
+        return;
+    }
+    if (counters->threads != workers) {
+        fprintf(stderr, "counters: not available (%d of %d workers could count, "
+                        "see /proc/sys/kernel/perf_event_paranoid)\n", counters->threads, workers);
+        return;
+    }
+
+    fprintf(stderr, "counters: ");
+    writeCounters(stderr, counters, (double) ((moves > 0) ? moves : 1), "move");
+    fprintf(stderr, "\n");
+    if (nodes > 0) {
+        fprintf(stderr, "counters: ");
+        writeCounters(stderr, counters, (double) nodes, "search node");
+        fprintf(stderr, "\n");
+    }
+}
+
+int writeReport(const char *path, void (*write)(FILE *)) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+    write(out);
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double interval = 1.0;
+    const char *jsonPath = NULL;
+    const char *csvPath = NULL;
+    int option;
+
+    runSeed = (uint64_t) time(NULL);
+    parsePolicySpec(DEFAULT_POLICY, &policySpec);
+
+    while ((option = getopt(argc, argv, "n:j:p:T:s:i:J:C:a:m:k:Ph")) != -1) {
+        switch (option) {
+            case 'n':
+                gameCount = strtoull(optarg, NULL, 10);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'p':
+            case 'T':
+                if (parsePolicySpec(optarg, (option == 'p') ? &policySpec : &opponentSpec) != 0) {
+                    fprintf(stderr, "Unknown policy '%s'.\n", optarg);
+                    return 1;
+                }
+                if (option == 'T')
+                    tournament = true;
+                break;
+            case 's':
+                runSeed = strtoull(optarg, NULL, 10);
+                break;
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'J':
+                jsonPath = optarg;
+                break;
+            case 'C':
+                csvPath = optarg;
+                break;
+            case 'a':
+                alpha = atof(optarg);
+                break;
+            case 'm':
+                minPairs = strtoull(optarg, NULL, 10);
+                break;
+            case 'k':
+                lookCount = atoi(optarg);
+                break;
+            case 'P':
+                countEvents = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (threads < 1 || alpha <= 0 || alpha >= 1 || lookCount < 1 || lookCount > MAX_LOOKS || gameCount == 0
+        || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Worker *workers = calloc((size_t) threads, sizeof(Worker));
+    if (workers == NULL) {
+        perror("nc2048-sim");
+        return 1;
+    }
+
+    if (tournament)
+        planLooks();
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < threads; i++) {
+        Worker *worker = &workers[i];
+        uint64_t policySeed = gameSeed(runSeed, gameCount + (uint64_t) i);
+
+        initStats(&worker->stats);
+        initStats(&worker->opponentStats);
+        for (int k = 0; k < MAX_LOOKS; k++)
+            initPairedStats(&worker->paired[k]);
+        pthread_mutex_init(&worker->pairedLock, NULL);
+
+        if (initPolicy(&worker->policy, &policySpec, policySeed) != 0
+            || (tournament && initPolicy(&worker->opponent, &opponentSpec, ~policySeed) != 0)) {
+            perror("nc2048-sim");
+            return 1;
+        }
+        pthread_create(&worker->thread, NULL, runWorker, worker);
+    }
+
+    double lastReport = 0;
+    for (;;) {
+        int running = 0;
+        for (int i = 0; i < threads; i++)
+            if (!__atomic_load_n(&workers[i].done, __ATOMIC_ACQUIRE))
+                running++;
+        if (running == 0)
+            break;
+
+        struct timespec pause = {0, POLL_MS * 1000000L};
+        nanosleep(&pause, NULL);
+
+        double elapsed = elapsedSince(&start);
+        if (interval > 0 && elapsed - lastReport >= interval) {
+            printProgress(workers, threads, elapsed);
+            lastReport = elapsed;
+        }
+
+        if (tournament && !decided && testLooks(workers, threads)) {
+            decided = true;
+            __atomic_store_n(&stopping, true, __ATOMIC_RELAXED);
+        }
+    }
+
+    for (int i = 0; i < threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    /*  The last looks may only have become complete after the workers' last poll.  */
+    if (tournament) {
+        if (!decided)
+            decided = testLooks(workers, threads);
+        if (!decided)
+            nextLook = lookCount - 1;
+        stoppedEarly = decided && nextLook < lookCount - 1;
+        collectPairs(workers, threads, nextLook, &pairedTotal);
+    }
+
+    initStats(&total);
+    initStats(&opponentTotal);
+    CounterValues counters;
+    uint64_t moves = 0;
+    uint64_t nodes = 0;
+    memset(&counters, 0, sizeof(CounterValues));
+    for (int i = 0; i < threads; i++) {
+        mergeStats(&total, &workers[i].stats);
+        mergeStats(&opponentTotal, &workers[i].opponentStats);
+        addCounterValues(&counters, &workers[i].counters);
+        moves += workers[i].moves;
+        nodes += workers[i].policy.nodes + workers[i].opponent.nodes;
+        freePolicy(&workers[i].policy);
+        if (tournament)
+            freePolicy(&workers[i].opponent);
+        pthread_mutex_destroy(&workers[i].pairedLock);
+    }
+    seconds = elapsedSince(&start);
+
+    char policyName[32];
+    formatPolicySpec(&policySpec, policyName, sizeof(policyName));
+    fprintf(stderr, "%llu games with %s (seed %llu) in %.2fs: mean score %.0f, reached 2048 in %.1f%%\n",
+            (unsigned long long) total.games, policyName, (unsigned long long) runSeed, seconds,
+            (total.games > 0) ? total.score.sum / (double) total.games : 0.0, reachRate(&total, 11) * 100.0);
+
+    if (tournament) {
+        char opponentName[32];
+        double margin = normalQuantile(lookAlpha[nextLook]) * pairedStandardError(&pairedTotal);
+        formatPolicySpec(&opponentSpec, opponentName, sizeof(opponentName));
+        fprintf(stderr, "%s - %s: %.1f over %llu games, interval [%.1f, %.1f] at look %d/%d (%.1f%% over all looks), "
+                        "p = %.3g, %s%s\n", policyName, opponentName, pairedTotal.mean[2],
+                (unsigned long long) pairedTotal.count, pairedTotal.mean[2] - margin, pairedTotal.mean[2] + margin,
+                nextLook + 1, lookCount, (1.0 - alpha) * 100.0, pairedPValue(&pairedTotal),
+                decided ? "significant" : "not significant", stoppedEarly ? " (stopped early)" : "");
+    }
+    reportTableMemory(stderr);
+    if (countEvents)
+        printCounters(&counters, threads, moves, nodes);
+
+    int result = 0;
+    if (jsonPath != NULL && writeReport(jsonPath, writeJson) != 0)
+        result = 1;
+    if (csvPath != NULL && writeReport(csvPath, writeCsv) != 0)
+        result = 1;
+    if (jsonPath == NULL && csvPath == NULL)
+        writeJson(stdout);
+
+    free(workers);
+    return result;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*  Local header files  */
+#include "tablebase.h"
+
+/**
+ * Prints how to use nc2048-solve.
+ * @param name Name the program was started with.
+ */
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-s size] [-t target] [-j threads] <table>\n"
+            "  Solves every reachable size x size game exactly and writes the tablebase to <table>.\n"
+            "  -s size     board side length, 2 to 4 (default 3)\n"
+            "  -t target   winning block exponent, e.g. 9 for 512; 0 plays games out (default 0)\n"
+            "  -j threads  worker threads (default: all CPUs)\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    int size = 3;
+    int target = 0;
+    int threads = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:t:j:h")) != -1) {
+        switch (option) {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 't':
+                target = atoi(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (solveTablebase(argv[optind], size, target, threads) != 0) {
+        perror("nc2048-solve");
+        return 1;
+    }
+
+    Tablebase *table = openTablebase(argv[optind]);
+    if (table == NULL) {
+        perror("nc2048-solve");
+        return 1;
+    }
+    fprintf(stderr, "Wrote %llu states to %s\n", (unsigned long long) table->header->states, argv[optind]);
+    closeTablebase(table);
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "montecarlo.h"
+
+#define CACHE_LINE 64
+/*  Guided rollouts prefer moves that leave many empty cells, worth this much score each.  */
+#define EMPTY_CELL_BONUS 16
+
+/*
+ * Pure Monte Carlo: every legal move of the current board is followed by a share of the rollout budget, each
+ * playing random (or lightly guided) moves from there. The move with the best mean score gained wins.
+ * Rollout i belongs to thread i % threads, so no thread needs more than its own RolloutWorker. Each thread
+ * cycles through the legal moves with its own rollouts, starting at a different move per thread: every thread
+ * plays every move about equally often, and rollouts after a bad move, which end sooner, don't leave some threads
+ * with less work than others.
+ */
+
+static int pickRolloutMove(RolloutWorker *worker, Board board, int guided, Board *next, int *gained) {
+    int best = DIR_NONE;
+    int bestValue = 0;
+    int ties = 0;
+
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        int dirGained;
+        Board moved = boardMove(board, dir, &dirGained);
+        if (moved == board)
+            continue;
+
+        int value = guided ? dirGained + EMPTY_CELL_BONUS * boardEmptyCount(moved, SIZE) : 0;
+
+        // Uniform choice among the best moves (among all legal moves when unguided).
+        if (best == DIR_NONE || value > bestValue) {
+            ties = 1;
+        } else if (value == bestValue) {
+            if (rngInt(&worker->rng, ties++) != 0)
+                continue;
+        } else {
+            continue;
+        }
+
+        best = dir;
+        bestValue = value;
+        *next = moved;
+        *gained = dirGained;
+    }
+
+    return best;
+}
+
+static double rollout(RolloutWorker *worker, Board moved, int depth, int guided) {
+    Board board = boardSpawn(moved, SIZE, &worker->rng);
+    double score = 0;
+
+    for (int step = 0; depth == 0 || step < depth; step++) {
+        Board next;
+        int gained;
+        if (pickRolloutMove(worker, board, guided, &next, &gained) == DIR_NONE)
+            break;
+
+        board = boardSpawn(next, SIZE, &worker->rng);
+        score += gained;
+        worker->moves++;
+    }
+
+    return score;
+}
+
+static void runShare(MonteCarlo *monteCarlo, int index) {
+    RolloutWorker *worker = &monteCarlo->workers[index];
+
+    memset(worker->sums, 0, sizeof(worker->sums));
+    memset(worker->counts, 0, sizeof(worker->counts));
+    worker->moves = 0;
+
+    for (int i = index; i < monteCarlo->rollouts; i += monteCarlo->threads) {
+        int dir = monteCarlo->legal[(i / monteCarlo->threads + index) % monteCarlo->legalCount];
+        worker->sums[dir] += monteCarlo->gained[dir]
+                             + rollout(worker, monteCarlo->moved[dir], monteCarlo->depth, monteCarlo->guided);
+        worker->counts[dir]++;
+    }
+}
+
+static void *runHelper(void *arg) {
+    RolloutHelper *helper = arg;
+    MonteCarlo *monteCarlo = helper->monteCarlo;
+    int index = helper->index;
+    unsigned seen = 0;
+
+    initBoardTables();
+    pthread_mutex_lock(&monteCarlo->lock);
+    for (;;) {
+        while (!monteCarlo->stopping && monteCarlo->generation == seen)
+            pthread_cond_wait(&monteCarlo->started, &monteCarlo->lock);
+        if (monteCarlo->stopping)
+            break;
+        seen = monteCarlo->generation;
+        pthread_mutex_unlock(&monteCarlo->lock);
+
+        runShare(monteCarlo, index);
+
+        pthread_mutex_lock(&monteCarlo->lock);
+        if (--monteCarlo->busy == 0)
+            pthread_cond_signal(&monteCarlo->finished);
+    }
+    pthread_mutex_unlock(&monteCarlo->lock);
+    return NULL;
+}
+
+/**
+ * Prepares a Monte Carlo move picker and starts its helper threads.
+ * @param monteCarlo
+ * @param threads Threads sharing the rollouts of a decision, including the caller of monteCarloMove().
+ * @param seed Seeds the rollouts. Every thread gets its own stream derived from it.
+ * @return 0 on success, -1 on failure.
+ */
+int initMonteCarlo(MonteCarlo *monteCarlo, int threads, uint64_t seed) {
+    memset(monteCarlo, 0, sizeof(MonteCarlo));
+    monteCarlo->threads = (threads > 0) ? threads : 1;
+    initBoardTables();
+
+    void *workers;
+    if (posix_memalign(&workers, CACHE_LINE, (size_t) monteCarlo->threads * sizeof(RolloutWorker)) != 0)
+        return -1;
+    monteCarlo->workers = workers;
+
+    Rng seeds;
+    seedRng(&seeds, seed);
+    for (int i = 0; i < monteCarlo->threads; i++)
+        seedRng(&monteCarlo->workers[i].rng, nextRng(&seeds));
+
+    pthread_mutex_init(&monteCarlo->lock, NULL);
+    pthread_cond_init(&monteCarlo->started, NULL);
+    pthread_cond_init(&monteCarlo->finished, NULL);
+
+    if (monteCarlo->threads > 1) {
+        monteCarlo->helpers = calloc((size_t) monteCarlo->threads - 1, sizeof(RolloutHelper));
+        if (monteCarlo->helpers == NULL) {
+            freeMonteCarlo(monteCarlo);
+            return -1;
+        }
+
+        for (int i = 0; i < monteCarlo->threads - 1; i++) {
+            RolloutHelper *helper = &monteCarlo->helpers[i];
+            helper->monteCarlo = monteCarlo;
+            helper->index = i + 1;
+            if (pthread_create(&helper->thread, NULL, runHelper, helper) != 0) {
+                // Only the helpers started so far have to be stopped.
+                monteCarlo->threads = i + 1;
+                freeMonteCarlo(monteCarlo);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Stops the helper threads and releases the picker.
+ * @param monteCarlo
+ */
+void freeMonteCarlo(MonteCarlo *monteCarlo) {
+    if (monteCarlo->helpers != NULL) {
+        pthread_mutex_lock(&monteCarlo->lock);
+        monteCarlo->stopping = true;
+        pthread_cond_broadcast(&monteCarlo->started);
+        pthread_mutex_unlock(&monteCarlo->lock);
+
+        for (int i = 0; i < monteCarlo->threads - 1; i++)
+            pthread_join(monteCarlo->helpers[i].thread, NULL);
+        free(monteCarlo->helpers);
+        monteCarlo->helpers = NULL;
+    }
+
+    pthread_mutex_destroy(&monteCarlo->lock);
+    pthread_cond_destroy(&monteCarlo->started);
+    pthread_cond_destroy(&monteCarlo->finished);
+    free(monteCarlo->workers);
+    monteCarlo->workers = NULL;
+}
+
+/**
+ * Picks a move by playing rollouts after every legal move.
+ * @param monteCarlo
+ * @param board 4x4 board to move on.
+ * @param rollouts Rollout budget of this decision, split evenly over the legal moves.
+ * @param depth Moves per rollout, 0 to play until the game is over.
+ * @param guided false(0) for uniformly random rollout moves, true(1) to prefer joins and empty cells.
+ * @param result Receives the chosen move and the rollout means.
+ */
+void monteCarloMove(MonteCarlo *monteCarlo, Board board, int rollouts, int depth, int guided,
+                    MonteCarloResult *result) {
+    memset(result, 0, sizeof(MonteCarloResult));
+    result->move = DIR_NONE;
+
+    monteCarlo->legalCount = 0;
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        monteCarlo->moved[dir] = boardMove(board, dir, &monteCarlo->gained[dir]);
+        if (monteCarlo->moved[dir] != board)
+            monteCarlo->legal[monteCarlo->legalCount++] = dir;
+    }
+    if (monteCarlo->legalCount == 0)
+        return;
+
+    monteCarlo->rollouts = (rollouts > monteCarlo->legalCount) ? rollouts : monteCarlo->legalCount;
+    monteCarlo->depth = depth;
+    monteCarlo->guided = guided;
+
+    if (monteCarlo->threads > 1) {
+        pthread_mutex_lock(&monteCarlo->lock);
+        monteCarlo->busy = monteCarlo->threads - 1;
+        monteCarlo->generation++;
+        pthread_cond_broadcast(&monteCarlo->started);
+        pthread_mutex_unlock(&monteCarlo->lock);
+    }
+
+    runShare(monteCarlo, 0);
+
+    if (monteCarlo->threads > 1) {
+        pthread_mutex_lock(&monteCarlo->lock);
+        while (monteCarlo->busy > 0)
+            pthread_cond_wait(&monteCarlo->finished, &monteCarlo->lock);
+        pthread_mutex_unlock(&monteCarlo->lock);
+    }
+
+    double sums[DIR_COUNT] = {0};
+    uint64_t counts[DIR_COUNT] = {0};
+    for (int i = 0; i < monteCarlo->threads; i++) {
+        RolloutWorker *worker = &monteCarlo->workers[i];
+        for (int dir = 0; dir < DIR_COUNT; dir++) {
+            sums[dir] += worker->sums[dir];
+            counts[dir] += worker->counts[dir];
+        }
+        result->moves += worker->moves;
+    }
+
+    for (int i = 0; i < monteCarlo->legalCount; i++) {
+        int dir = monteCarlo->legal[i];
+        result->mean[dir] = sums[dir] / (double) counts[dir];
+        result->rollouts += counts[dir];
+        if (result->move == DIR_NONE || result->mean[dir] > result->mean[result->move])
+            result->move = dir;
+    }
+}
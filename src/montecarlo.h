@@ -0,0 +1,64 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "random.h"
+
+#ifndef NC2048_MONTECARLO_H
+#define NC2048_MONTECARLO_H
+
+/*  Random stream and rollout totals of one thread. Exactly one cache line, so threads never share one.  */
+typedef struct {
+    Rng rng;
+    double sums[DIR_COUNT];
+    uint32_t counts[DIR_COUNT];
+    uint64_t moves;
+} RolloutWorker;
+
+typedef struct MonteCarlo MonteCarlo;
+
+typedef struct {
+    MonteCarlo *monteCarlo;
+    int index;
+    pthread_t thread;
+} RolloutHelper;
+
+/*  Monte Carlo move picker. Rollouts of a decision are spread over <i>threads</i> threads: the calling thread
+ *  and a pool of helpers that sleep between decisions.  */
+struct MonteCarlo {
+    int threads;
+    RolloutWorker *workers;
+    RolloutHelper *helpers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t started;
+    pthread_cond_t finished;
+    unsigned generation;
+    int busy;
+    int stopping;
+
+    /*  Current decision.  */
+    Board moved[DIR_COUNT];
+    int gained[DIR_COUNT];
+    int legal[DIR_COUNT];
+    int legalCount;
+    int rollouts;
+    int depth;
+    int guided;
+};
+
+typedef struct {
+    int move;                   /*  Best move, DIR_NONE if the board can't move.            */
+    double mean[DIR_COUNT];     /*  Mean score gained per direction, 0 for illegal moves.  */
+    uint64_t rollouts;
+    uint64_t moves;             /*  Moves played in all rollouts.                           */
+} MonteCarloResult;
+
+extern int initMonteCarlo(MonteCarlo *monteCarlo, int threads, uint64_t seed);
+
+extern void freeMonteCarlo(MonteCarlo *monteCarlo);
+
+extern void monteCarloMove(MonteCarlo *monteCarlo, Board board, int rollouts, int depth, int guided,
+                           MonteCarloResult *result);
+
+#endif //NC2048_MONTECARLO_H
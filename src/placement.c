@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "global.h"
+#include "placement.h"
+
+#define HUGE_PAGE_SIZE ((size_t) 2 << 20)
+/*  Memory policies of mbind(), see set_mempolicy(2). Defined here to avoid depending on libnuma.  */
+#define MEMORY_POLICY_BIND 2
+#define MEMORY_POLICY_FLAG_STRICT 1
+/*  Distinct table names reportTableMemory() keeps apart.  */
+#define REPORT_ENTRIES 16
+
+typedef struct {
+    const char *name;
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t pages[PAGES_KINDS];
+    uint64_t bound;
+} ReportEntry;
+
+static pthread_once_t settingsOnce = PTHREAD_ONCE_INIT;
+static int nodeCount = 1;
+static int bestPages = PAGES_HUGE;
+static int numaEnabled = true;
+
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+static ReportEntry report[REPORT_ENTRIES];
+static int reportCount = 0;
+
+/**
+ * Reads the environment overrides and the machine's NUMA nodes, e.g. "0-1" or "0,2-3".
+ */
+static void readSettings() {
+    const char *pages = getenv("NC2048_PAGES");
+    const char *numa = getenv("NC2048_NUMA");
+
+    if (pages != NULL && strcmp(pages, "transparent") == 0)
+        bestPages = PAGES_TRANSPARENT;
+    else if (pages != NULL && strcmp(pages, "small") == 0)
+        bestPages = PAGES_SMALL;
+    if (numa != NULL && strcmp(numa, "off") == 0)
+        numaEnabled = false;
+
+    FILE *online = fopen("/sys/devices/system/node/online", "r");
+    if (online == NULL)
+        return;
+
+    int last = 0;
+    int first;
+    while (fscanf(online, "%d", &first) == 1) {
+        last = first;
+        if (fscanf(online, "-%d", &last) < 0)
+            break;
+        if (fgetc(online) != ',')
+            break;
+    }
+    fclose(online);
+
+    nodeCount = (last + 1 < MAX_NUMA_NODES) ? last + 1 : MAX_NUMA_NODES;
+}
+
+/**
+ * @return Number of NUMA nodes, 1 on machines without NUMA or when NC2048_NUMA=off.
+ */
+int numaNodeCount() {
+    pthread_once(&settingsOnce, readSettings);
+    return numaEnabled ? nodeCount : 1;
+}
+
+/**
+ * @return NUMA node of the CPU the calling thread runs on, 0 if unknown.
+ */
+int currentNumaNode() {
+    unsigned cpu;
+    unsigned node;
+
+    if (numaNodeCount() == 1 || syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= MAX_NUMA_NODES)
+        return 0;
+    return (int) node;
+}
+
+/**
+ * Checks whether transparent huge pages are enabled at all ("always" or "madvise").
+ */
+static int transparentPagesEnabled() {
+    char mode[128] = "";
+    FILE *in = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+
+    if (in == NULL)
+        return false;
+    if (fgets(mode, sizeof(mode), in) == NULL)
+        mode[0] = '\0';
+    fclose(in);
+    return strstr(mode, "[never]") == NULL && mode[0] != '\0';
+}
+
+/**
+ * Maps <i>size</i> bytes aligned to a huge page, so transparent huge pages can back all of it.
+ */
+static void *mapAligned(size_t size) {
+    char *mapped = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    size_t head = (HUGE_PAGE_SIZE - ((uintptr_t) mapped & (HUGE_PAGE_SIZE - 1))) & (HUGE_PAGE_SIZE - 1);
+    if (head > 0)
+        munmap(mapped, head);
+    munmap(mapped + head + size, HUGE_PAGE_SIZE - head);
+    return mapped + head;
+}
+
+static void addToReport(const char *name, const TableMemory *table) {
+    pthread_mutex_lock(&reportLock);
+
+    int i = 0;
+    while (i < reportCount && strcmp(report[i].name, name) != 0)
+        i++;
+    if (i == reportCount && reportCount < REPORT_ENTRIES) {
+        memset(&report[i], 0, sizeof(ReportEntry));
+        report[i].name = name;
+        reportCount++;
+    }
+
+    if (i < reportCount) {
+        report[i].count++;
+        report[i].bytes += table->size;
+        report[i].pages[table->pages]++;
+        if (table->node != NODE_FIRST_TOUCH)
+            report[i].bound++;
+    }
+
+    pthread_mutex_unlock(&reportLock);
+}
+
+/**
+ * Allocates zeroed memory for a large table, on the best pages the system gives out: explicit huge pages, then
+ * transparent huge pages, then plain 4K pages. Tables smaller than a huge page always get plain pages.
+ * @param table Receives the memory and where it was placed.
+ * @param name Names the table in reportTableMemory(). Must stay valid for as long as the program runs.
+ * @param size
+ * @param node NUMA node to bind the memory to, or NODE_FIRST_TOUCH. Binding is skipped on machines with a
+ *        single node, and silently dropped if the kernel refuses it.
+ * @return 0 on success, -1 if out of memory.
+ */
+int allocTableMemory(TableMemory *table, const char *name, size_t size, int node) {
+    int nodes = numaNodeCount();
+
+    memset(table, 0, sizeof(TableMemory));
+    table->size = size;
+    table->node = NODE_FIRST_TOUCH;
+    table->pages = PAGES_SMALL;
+
+    if (size >= HUGE_PAGE_SIZE && bestPages != PAGES_SMALL) {
+        size_t mappedSize = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+        if (bestPages == PAGES_HUGE) {
+            void *memory = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                table->memory = memory;
+                table->pages = PAGES_HUGE;
+            }
+        }
+
+        if (table->memory == NULL) {
+            table->memory = mapAligned(mappedSize);
+            if (table->memory != NULL && transparentPagesEnabled()
+                && madvise(table->memory, mappedSize, MADV_HUGEPAGE) == 0)
+                table->pages = PAGES_TRANSPARENT;
+        }
+
+        if (table->memory != NULL)
+            table->mappedSize = mappedSize;
+    }
+
+    if (table->memory == NULL) {
+        table->memory = calloc(1, size);
+        if (table->memory == NULL)
+            return -1;
+    }
+
+    // Pages are only placed once touched, so binding the fresh mapping covers all of it.
+    if (table->mappedSize > 0 && node >= 0 && node < nodes && nodes > 1) {
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_mbind, table->memory, table->mappedSize, MEMORY_POLICY_BIND, &mask,
+                    (unsigned long) nodes + 1, MEMORY_POLICY_FLAG_STRICT) == 0)
+            table->node = node;
+    }
+
+    addToReport(name, table);
+    return 0;
+}
+
+/**
+ * Releases memory of allocTableMemory().
+ * @param table
+ */
+void freeTableMemory(TableMemory *table) {
+    if (table->mappedSize > 0)
+        munmap(table->memory, table->mappedSize);
+    else
+        free(table->memory);
+    table->memory = NULL;
+}
+
+/**
+ * Copies a read-only table to every NUMA node. On a single node machine there is only one copy.
+ * @param replicated
+ * @param name Names the table in reportTableMemory().
+ * @param source
+ * @param size
+ * @return 0 on success, -1 if not even one copy could be allocated.
+ */
+int replicateTable(ReplicatedTable *replicated, const char *name, const void *source, size_t size) {
+    int nodes = numaNodeCount();
+
+    replicated->count = 0;
+    for (int node = 0; node < nodes; node++) {
+        TableMemory *copy = &replicated->copies[node];
+        if (allocTableMemory(copy, name, size, (nodes > 1) ? node : NODE_FIRST_TOUCH) != 0)
+            break;
+        memcpy(copy->memory, source, size);
+        replicated->count++;
+    }
+    return (replicated->count > 0) ? 0 : -1;
+}
+
+/**
+ * @param replicated
+ * @return The copy on the calling thread's node, or the first one if that node has none.
+ */
+const void *localReplica(const ReplicatedTable *replicated) {
+    int node = currentNumaNode();
+    return replicated->copies[(node < replicated->count) ? node : 0].memory;
+}
+
+/**
+ * Prints where the tables allocated so far were placed, one line per table name.
+ * @param out
+ */
+void reportTableMemory(FILE *out) {
+    static const char *pageNames[PAGES_KINDS] = {"huge pages", "transparent huge pages", "4K pages"};
+
+    pthread_mutex_lock(&reportLock);
+    for (int i = 0; i < reportCount; i++) {
+        ReportEntry *entry = &report[i];
+
+        fprintf(out, "memory: %s, %llu x %.1f MiB on ", entry->name, (unsigned long long) entry->count,
+                (double) entry->bytes / (double) entry->count / (1 << 20));
+        for (int pages = 0, listed = 0; pages < PAGES_KINDS; pages++) {
+            if (entry->pages[pages] == 0)
+                continue;
+            fprintf(out, "%s%s", (listed++ > 0) ? " + " : "", pageNames[pages]);
+            if (entry->pages[pages] != entry->count)
+                fprintf(out, " (%llu)", (unsigned long long) entry->pages[pages]);
+        }
+
+        if (entry->bound == entry->count)
+            fprintf(out, ", bound to one NUMA node each\n");
+        else if (entry->bound > 0)
+            fprintf(out, ", %llu bound to a NUMA node\n", (unsigned long long) entry->bound);
+        else
+            fprintf(out, ", placed by first touch\n");
+    }
+    pthread_mutex_unlock(&reportLock);
+}
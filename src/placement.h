@@ -0,0 +1,57 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef NC2048_PLACEMENT_H
+#define NC2048_PLACEMENT_H
+
+/*  Kinds of pages a table can end up on, from the best to the fallback.  */
+#define PAGES_HUGE 0            /*  Explicit huge pages (MAP_HUGETLB), needs pages reserved in vm.nr_hugepages.  */
+#define PAGES_TRANSPARENT 1     /*  Transparent huge pages, asked for with madvise().                            */
+#define PAGES_SMALL 2           /*  Plain 4K pages.                                                             */
+#define PAGES_KINDS 3
+
+/*  Node argument of allocTableMemory(): let the first thread that touches a page decide where it goes.  */
+#define NODE_FIRST_TOUCH (-1)
+/*  Largest number of NUMA nodes tables are replicated on.  */
+#define MAX_NUMA_NODES 16
+
+/*
+ * Large tables (row tables, transposition tables) are put on huge pages where the system allows it, which
+ * saves most of the TLB misses of random lookups. On machines with several NUMA nodes, read-only tables are
+ * replicated once per node and every thread reads its own node's copy; tables owned by a single thread are left
+ * to first touch, which puts them on that thread's node.
+ *
+ * NC2048_PAGES=huge|transparent|small caps the kind of pages that is tried, NC2048_NUMA=off disables binding
+ * and replication.
+ */
+
+typedef struct {
+    void *memory;
+    size_t size;
+    size_t mappedSize;          /*  0 if the memory came from calloc().  */
+    int pages;                  /*  One of the PAGES_* values.            */
+    int node;                   /*  NUMA node it's bound to, or NODE_FIRST_TOUCH.  */
+} TableMemory;
+
+/*  Read-only table with one copy per NUMA node.  */
+typedef struct {
+    TableMemory copies[MAX_NUMA_NODES];
+    int count;
+} ReplicatedTable;
+
+extern int numaNodeCount();
+
+extern int currentNumaNode();
+
+extern int allocTableMemory(TableMemory *table, const char *name, size_t size, int node);
+
+extern void freeTableMemory(TableMemory *table);
+
+extern int replicateTable(ReplicatedTable *replicated, const char *name, const void *source, size_t size);
+
+extern const void *localReplica(const ReplicatedTable *replicated);
+
+extern void reportTableMemory(FILE *out);
+
+#endif //NC2048_PLACEMENT_H
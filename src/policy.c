@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "policy.h"
+
+#define DEFAULT_SEARCH_DEPTH 2
+#define DEFAULT_ROLLOUTS 100
+/*  Transposition table size of searching policies, as a power of two of entries.  */
+#define POLICY_TABLE_BITS 16
+
+/**
+ * Parses a policy description: "random", "search[:depth]" or "mc[:rollouts[:depth[:threads]]]", where "mcg"
+ * instead of "mc" guides the rollouts.
+ * @param text
+ * @param spec Receives the settings.
+ * @return 0 on success, -1 if <i>text</i> is not a valid policy.
+ */
+int parsePolicySpec(const char *text, PolicySpec *spec) {
+    const char *argument = strchr(text, ':');
+    size_t length = (argument != NULL) ? (size_t) (argument - text) : strlen(text);
+
+    memset(spec, 0, sizeof(PolicySpec));
+
+    if (length == 6 && strncmp(text, "random", length) == 0 && argument == NULL) {
+        spec->type = POLICY_RANDOM;
+        return 0;
+    }
+
+    if (length == 6 && strncmp(text, "search", length) == 0) {
+        spec->type = POLICY_SEARCH;
+        spec->depth = (argument != NULL) ? atoi(argument + 1) : DEFAULT_SEARCH_DEPTH;
+        return (spec->depth >= 1) ? 0 : -1;
+    }
+
+    if ((length == 2 && strncmp(text, "mc", length) == 0) || (length == 3 && strncmp(text, "mcg", length) == 0)) {
+        spec->type = POLICY_MONTE_CARLO;
+        spec->guided = (length == 3);
+        spec->rollouts = DEFAULT_ROLLOUTS;
+        spec->threads = 1;
+        if (argument != NULL && sscanf(argument + 1, "%d:%d:%d", &spec->rollouts, &spec->depth, &spec->threads) < 1)
+            return -1;
+        return (spec->rollouts >= 1 && spec->depth >= 0 && spec->threads >= 1) ? 0 : -1;
+    }
+
+    return -1;
+}
+
+/**
+ * Writes a policy description in the format parsePolicySpec() reads.
+ * @param spec
+ * @param out
+ * @param size Size of <i>out</i>.
+ */
+void formatPolicySpec(const PolicySpec *spec, char *out, size_t size) {
+    switch (spec->type) {
+        case POLICY_SEARCH:
+            snprintf(out, size, "search:%d", spec->depth);
+            break;
+        case POLICY_MONTE_CARLO:
+            snprintf(out, size, "%s:%d:%d:%d", spec->guided ? "mcg" : "mc", spec->rollouts, spec->depth,
+                     spec->threads);
+            break;
+        default:
+            snprintf(out, size, "random");
+            break;
+    }
+}
+
+/**
+ * Prepares the per thread state of a policy.
+ * @param policy
+ * @param spec
+ * @param seed Seeds the policy's own random choices. Independent of the spawns.
+ * @return 0 on success, -1 if out of memory.
+ */
+int initPolicy(Policy *policy, const PolicySpec *spec, uint64_t seed) {
+    policy->spec = *spec;
+    policy->nodes = 0;
+    seedRng(&policy->rng, seed);
+
+    if (initSearch(&policy->search, (spec->type == POLICY_SEARCH) ? POLICY_TABLE_BITS : 0) != 0)
+        return -1;
+    if (spec->type == POLICY_MONTE_CARLO
+        && initMonteCarlo(&policy->monteCarlo, spec->threads, nextRng(&policy->rng)) != 0) {
+        freeSearch(&policy->search);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Releases the state of a policy.
+ * @param policy
+ */
+void freePolicy(Policy *policy) {
+    freeSearch(&policy->search);
+    if (policy->spec.type == POLICY_MONTE_CARLO)
+        freeMonteCarlo(&policy->monteCarlo);
+}
+
+static int chooseRandomMove(Policy *policy, Board board) {
+    int legal[DIR_COUNT];
+    int count = 0;
+
+    for (int dir = 0; dir < DIR_COUNT; dir++)
+        if (boardMove(board, dir, NULL) != board)
+            legal[count++] = dir;
+
+    return (count > 0) ? legal[rngInt(&policy->rng, count - 1)] : DIR_NONE;
+}
+
+/**
+ * Picks the next move.
+ * @param policy
+ * @param board
+ * @return One of the DIR_* values, DIR_NONE if the game is over.
+ */
+int choosePolicyMove(Policy *policy, Board board) {
+    switch (policy->spec.type) {
+        case POLICY_SEARCH: {
+            SearchResult result;
+            searchBoard(&policy->search, board, policy->spec.depth, &result);
+            policy->nodes += result.nodes;
+            return result.move;
+        }
+        case POLICY_MONTE_CARLO: {
+            MonteCarloResult result;
+            monteCarloMove(&policy->monteCarlo, board, policy->spec.rollouts, policy->spec.depth,
+                           policy->spec.guided, &result);
+            policy->nodes += result.moves;
+            return result.move;
+        }
+        default:
+            return chooseRandomMove(policy, board);
+    }
+}
+
+/**
+ * Plays a whole 4x4 game. Blocks keep growing past 2^15, so strong policies can play for millions of moves.
+ * @param policy
+ * @param seed Seeds the spawns: the same seed always produces the same spawns for the same moves.
+ * @param result Receives the outcome.
+ */
+void playGame(Policy *policy, uint64_t seed, GameResult *result) {
+    playGameObserved(policy, seed, result, NULL, NULL);
+}
+
+/**
+ * Plays a whole 4x4 game like playGame(), showing every position to an observer.
+ * @param policy
+ * @param seed
+ * @param result Receives the outcome.
+ * @param observer Called before the first move and after every move (including its spawn), may be NULL.
+ * @param context Passed to <i>observer</i>.
+ */
+void playGameObserved(Policy *policy, uint64_t seed, GameResult *result, GameObserver observer,
+                      void *context) {
+    struct timespec start, end;
+    Rng spawns;
+    WideBoard board;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    seedRng(&spawns, seed);
+    wideBoardInit(&board, boardNew(SIZE, &spawns));
+
+    uint64_t score = 0;
+    uint32_t moves = 0;
+
+    if (observer != NULL)
+        observer(context, &board, score);
+
+    for (;;) {
+        int dir = choosePolicyMove(policy, board.board);
+        uint64_t gained;
+
+        // The policy only sees blocks past the cap clamped to it, so its choice may not move the real board,
+        // or it may miss that joining two capped blocks is still possible.
+        if (dir == DIR_NONE || wideBoardMove(&board, dir, SIZE, &gained) == false) {
+            for (dir = 0; dir < DIR_COUNT; dir++)
+                if (wideBoardMove(&board, dir, SIZE, &gained) == true)
+                    break;
+            if (dir == DIR_COUNT)
+                break;
+        }
+
+        wideBoardSpawn(&board, SIZE, &spawns);
+        score += gained;
+        moves++;
+
+        if (observer != NULL)
+            observer(context, &board, score);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->score = score;
+    result->moves = moves;
+    result->maxExponent = wideBoardMaxExponent(&board, SIZE);
+    result->seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ * Derives the spawn seed of one game of a run, so every game of a run is reproducible on its own, no matter
+ * which thread plays it.
+ * @param runSeed
+ * @param game Index of the game in the run.
+ * @return
+ */
+uint64_t gameSeed(uint64_t runSeed, uint64_t game) {
+    Rng rng;
+    seedRng(&rng, runSeed ^ (game * 0xD1B54A32D192ED03ULL));
+    return nextRng(&rng);
+}
@@ -0,0 +1,61 @@
+#include <stdint.h>
+
+#include "board.h"
+#include "random.h"
+#include "search.h"
+#include "montecarlo.h"
+
+#ifndef NC2048_POLICY_H
+#define NC2048_POLICY_H
+
+/*  Ways of picking moves in simulated games.  */
+#define POLICY_RANDOM 0     /*  Uniformly random legal move.     */
+#define POLICY_SEARCH 1     /*  Expectimax search, see search.h.   */
+#define POLICY_MONTE_CARLO 2 /*  Rollouts, see montecarlo.h.      */
+
+/*  Policy settings, shared by all threads.  */
+typedef struct {
+    int type;
+    int depth;              /*  Search depth, or moves per rollout (0: until the game is over).  */
+    int rollouts;           /*  POLICY_MONTE_CARLO: rollouts per move.                          */
+    int threads;            /*  POLICY_MONTE_CARLO: threads sharing the rollouts of a move.     */
+    int guided;             /*  POLICY_MONTE_CARLO: lightly guided instead of random rollouts. */
+} PolicySpec;
+
+/*  Policy state of one thread.  */
+typedef struct {
+    PolicySpec spec;
+    Rng rng;
+    Search search;
+    MonteCarlo monteCarlo;
+    uint64_t nodes;         /*  Search nodes, or rollout moves.  */
+} Policy;
+
+typedef struct {
+    uint64_t score;
+    uint32_t moves;
+    int maxExponent;
+    double seconds;
+} GameResult;
+
+/*  Sees the board and score of a played game before the first move and after every move.  */
+typedef void (*GameObserver)(void *context, const WideBoard *board, uint64_t score);
+
+extern int parsePolicySpec(const char *text, PolicySpec *spec);
+
+extern void formatPolicySpec(const PolicySpec *spec, char *out, size_t size);
+
+extern int initPolicy(Policy *policy, const PolicySpec *spec, uint64_t seed);
+
+extern void freePolicy(Policy *policy);
+
+extern int choosePolicyMove(Policy *policy, Board board);
+
+extern void playGame(Policy *policy, uint64_t seed, GameResult *result);
+
+extern void playGameObserved(Policy *policy, uint64_t seed, GameResult *result, GameObserver observer,
+                             void *context);
+
+extern uint64_t gameSeed(uint64_t runSeed, uint64_t game);
+
+#endif //NC2048_POLICY_H
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include "global.h"
+#include "queue.h"
+
+/**
+ * Prepares an empty queue.
+ * @param queue
+ * @param capacity Maximum number of queued items.
+ * @return 0 on success, -1 if out of memory.
+ */
+int initQueue(Queue *queue, size_t capacity) {
+    queue->items = malloc(capacity * sizeof(void *));
+    if (queue->items == NULL)
+        return -1;
+
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->notEmpty, NULL);
+    pthread_cond_init(&queue->notFull, NULL);
+    return 0;
+}
+
+/**
+ * Releases the queue. No thread may still be using it.
+ * @param queue
+ */
+void freeQueue(Queue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_cond_destroy(&queue->notFull);
+    free(queue->items);
+    queue->items = NULL;
+}
+
+/**
+ * Appends an item, waiting for space if the queue is full.
+ * @param queue
+ * @param item
+ */
+void pushQueue(Queue *queue, void *item) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity)
+        pthread_cond_wait(&queue->notFull, &queue->lock);
+
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Removes the oldest item, waiting for one if the queue is empty.
+ * @param queue
+ * @return The item, or NULL once the queue is closed and drained.
+ */
+void *popQueue(Queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed)
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+
+    void *item = NULL;
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->notFull);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+/**
+ * Marks the end of input. Consumers drain the remaining items, then popQueue() returns NULL.
+ * @param queue
+ */
+void closeQueue(Queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,31 @@
+#include <pthread.h>
+#include <stddef.h>
+
+#ifndef NC2048_QUEUE_H
+#define NC2048_QUEUE_H
+
+/*  Fixed capacity FIFO of pointers shared between threads. Producers block while it is full, consumers block
+ *  while it is empty.  */
+typedef struct {
+    void **items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    int closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} Queue;
+
+extern int initQueue(Queue *queue, size_t capacity);
+
+extern void freeQueue(Queue *queue);
+
+extern void pushQueue(Queue *queue, void *item);
+
+extern void *popQueue(Queue *queue);
+
+extern void closeQueue(Queue *queue);
+
+#endif //NC2048_QUEUE_H
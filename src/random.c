@@ -34,4 +34,35 @@ int randInt(int upperLimit) {
     } while (retval > upperLimit);
 
     return retval;
+}
+
+/**
+ * Seeds an independent random number stream. Streams seeded with the same value produce the same numbers.
+ * @param rng
+ * @param seed
+ */
+void seedRng(Rng *rng, uint64_t seed) {
+    *rng = seed;
+}
+
+/**
+ * Returns the next 64 random bits of a stream (splitmix64).
+ * @param rng
+ * @return
+ */
+uint64_t nextRng(Rng *rng) {
+    uint64_t z = (*rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Returns a random integer with a value in the [0, upperLimit] range, like randInt(), from a stream.
+ * @param rng
+ * @param upperLimit Upper limit.
+ * @return
+ */
+int rngInt(Rng *rng, int upperLimit) {
+    return (int) (((nextRng(rng) >> 32) * (uint64_t) (upperLimit + 1)) >> 32);
 }
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include "global.h"
 
 #ifndef NC2048_RANDOM_H
@@ -7,4 +9,12 @@ extern void initRandom();
 extern int randInt(int upperLimit);
 #define randFieldCoordinate() randInt(SIZE - 1)
 
+/*  State of an independent random number stream, for code that can't share the global generator
+ *  (threads, sessions, reproducible runs).  */
+typedef uint64_t Rng;
+
+extern void seedRng(Rng *rng, uint64_t seed);
+extern uint64_t nextRng(Rng *rng);
+extern int rngInt(Rng *rng, int upperLimit);
+
 #endif //NC2048_RANDOM_H
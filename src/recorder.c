@@ -0,0 +1,266 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "recorder.h"
+
+/*  Escape sequences, as they appear inside JSON strings.  */
+#define ESC "\\u001b["
+#define CLEAR_SCREEN ESC "?25l" ESC "2J" ESC "H"
+#define CLEAR_LINE ESC "K"
+#define FRAME_END "\"]\n"
+
+#define SCORE_ROW 1
+#define FIELD_ROW 3
+#define MESSAGE_ROW (SIZE + 4)
+#define FIELD_COLUMN 2
+/*  Cell text: cursor position and the block, e.g. "\u001b[3;2H[2048]".  */
+#define CELL_TEXT_LENGTH 32
+/*  Upper bound of the buffer space a single frame or message takes.  */
+#define FRAME_TEXT_LENGTH 256
+#define MESSAGE_LENGTH 64
+#define TITLE_LENGTH 256
+
+/*  Every cell of every block value, rendered once and shared by all recorders.  */
+static char cellText[SIZE][SIZE][DISPLAY_MAX_EXPONENT + 1][CELL_TEXT_LENGTH];
+static size_t cellLength[SIZE][SIZE][DISPLAY_MAX_EXPONENT + 1];
+static pthread_once_t cellsOnce = PTHREAD_ONCE_INIT;
+
+static void renderCells() {
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            for (int value = 0; value <= DISPLAY_MAX_EXPONENT; value++) {
+                int length = snprintf(cellText[y][x][value], CELL_TEXT_LENGTH, ESC "%d;%dH%s", FIELD_ROW + y,
+                                      FIELD_COLUMN + 7 * x, displayBlock(value));
+                cellLength[y][x][value] = (size_t) length;
+            }
+        }
+    }
+}
+
+static void addPiece(Recorder *recorder, const char *text, size_t length) {
+    // Text formatted right after the previous piece just extends it.
+    if (recorder->pieceCount > 0) {
+        struct iovec *last = &recorder->pieces[recorder->pieceCount - 1];
+        if ((const char *) last->iov_base + last->iov_len == text) {
+            last->iov_len += length;
+            return;
+        }
+    }
+
+    recorder->pieces[recorder->pieceCount].iov_base = (void *) text;
+    recorder->pieces[recorder->pieceCount].iov_len = length;
+    recorder->pieceCount++;
+}
+
+/**
+ * Formats text into the buffer and adds it as a piece.
+ */
+static void addText(Recorder *recorder, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void addText(Recorder *recorder, const char *format, ...) {
+    char *start = recorder->buffer + recorder->used;
+    va_list arguments;
+
+    va_start(arguments, format);
+    int length = vsnprintf(start, RECORDER_BUFFER_SIZE - recorder->used, format, arguments);
+    va_end(arguments);
+
+    recorder->used += (size_t) length;
+    addPiece(recorder, start, (size_t) length);
+}
+
+/**
+ * Adds text as the contents of a JSON string. Control characters are replaced by spaces.
+ */
+static void addEscaped(Recorder *recorder, const char *text, int limit) {
+    char *start = recorder->buffer + recorder->used;
+    char *out = start;
+
+    for (int i = 0; i < limit && text[i] != '\0'; i++) {
+        if (text[i] == '"' || text[i] == '\\')
+            *out++ = '\\';
+        *out++ = ((unsigned char) text[i] < ' ') ? ' ' : text[i];
+    }
+
+    recorder->used += (size_t) (out - start);
+    addPiece(recorder, start, (size_t) (out - start));
+}
+
+/**
+ * Makes sure the next frame fits, flushing the buffered frames if not.
+ */
+static int reserveFrame(Recorder *recorder) {
+    if (recorder->pieceCount + SIZE * SIZE + 4 > RECORDER_PIECES
+        || recorder->used + FRAME_TEXT_LENGTH > RECORDER_BUFFER_SIZE)
+        return flushRecorder(recorder);
+    return 0;
+}
+
+/**
+ * Creates a recording and writes its header.
+ * @param recorder
+ * @param path File to write, "-" for stdout.
+ * @param title Title stored in the recording, may be NULL.
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+int openRecorder(Recorder *recorder, const char *path, const char *title) {
+    pthread_once(&cellsOnce, renderCells);
+    memset(recorder, 0, sizeof(Recorder));
+    memset(recorder->cells, -1, sizeof(recorder->cells));
+
+    recorder->buffer = malloc(RECORDER_BUFFER_SIZE);
+    recorder->pieces = malloc(RECORDER_PIECES * sizeof(struct iovec));
+    if (recorder->buffer == NULL || recorder->pieces == NULL) {
+        free(recorder->buffer);
+        free(recorder->pieces);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    recorder->fd = (strcmp(path, "-") == 0) ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (recorder->fd < 0) {
+        int error = errno;
+        free(recorder->buffer);
+        free(recorder->pieces);
+        errno = error;
+        return -1;
+    }
+
+    addText(recorder, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld", RECORDER_WIDTH,
+            RECORDER_HEIGHT, (long long) time(NULL));
+    if (title != NULL) {
+        addText(recorder, ", \"title\": \"");
+        addEscaped(recorder, title, TITLE_LENGTH);
+        addText(recorder, "\"");
+    }
+    addText(recorder, ", \"env\": {\"TERM\": \"xterm-256color\"}}\n");
+    return 0;
+}
+
+/**
+ * Records the field as it is now. Only cells that changed since the previous frame are drawn; nothing is recorded
+ * if the field and score didn't change at all.
+ * @param recorder
+ * @param time Seconds since the start of the recording.
+ * @param _field
+ * @param score
+ */
+void recordFrame(Recorder *recorder, double time, Field _field, uint64_t score) {
+    if (recorder->failed || reserveFrame(recorder) != 0)
+        return;
+
+    int firstPiece = recorder->pieceCount;
+    size_t firstByte = recorder->used;
+    int changed = false;
+
+    addText(recorder, "[%.6f, \"o\", \"%s", time, (recorder->frames == 0) ? CLEAR_SCREEN "Score:" : "");
+
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            int value = _field[y][x];
+            if (value < 0 || value > DISPLAY_MAX_EXPONENT)
+                value = 0;
+            if (value == recorder->cells[y][x])
+                continue;
+
+            addPiece(recorder, cellText[y][x][value], cellLength[y][x][value]);
+            recorder->cells[y][x] = value;
+            changed = true;
+        }
+    }
+
+    if (score != recorder->score || recorder->frames == 0) {
+        addText(recorder, ESC "%d;9H%llu" CLEAR_LINE, SCORE_ROW, (unsigned long long) score);
+        recorder->score = score;
+        changed = true;
+    }
+
+    if (changed == false) {
+        recorder->pieceCount = firstPiece;
+        recorder->used = firstByte;
+        return;
+    }
+
+    addPiece(recorder, FRAME_END, strlen(FRAME_END));
+    recorder->frames++;
+}
+
+/**
+ * Shows a message below the field, replacing the previous one. An empty message clears the line.
+ * @param recorder
+ * @param time Seconds since the start of the recording.
+ * @param message At most MESSAGE_LENGTH chars are shown.
+ */
+void recordMessage(Recorder *recorder, double time, const char *message) {
+    if (recorder->failed || reserveFrame(recorder) != 0)
+        return;
+
+    addText(recorder, "[%.6f, \"o\", \"" ESC "%d;1H" CLEAR_LINE, time, MESSAGE_ROW);
+    addEscaped(recorder, message, MESSAGE_LENGTH);
+    addPiece(recorder, FRAME_END, strlen(FRAME_END));
+    recorder->frames++;
+}
+
+/**
+ * Writes everything recorded so far.
+ * @param recorder
+ * @return 0 on success, -1 with errno set if the recording could not be written.
+ */
+int flushRecorder(Recorder *recorder) {
+    struct iovec *pieces = recorder->pieces;
+    int count = recorder->pieceCount;
+
+    if (recorder->failed) {
+        errno = EIO;
+        return -1;
+    }
+
+    while (count > 0) {
+        ssize_t written = writev(recorder->fd, pieces, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            recorder->failed = true;
+            return -1;
+        }
+
+        // Skip what was written, the rest goes out with the next call.
+        while (count > 0 && (size_t) written >= pieces->iov_len) {
+            written -= (ssize_t) pieces->iov_len;
+            pieces++;
+            count--;
+        }
+        if (count > 0) {
+            pieces->iov_base = (char *) pieces->iov_base + written;
+            pieces->iov_len -= (size_t) written;
+        }
+    }
+
+    recorder->pieceCount = 0;
+    recorder->used = 0;
+    return 0;
+}
+
+/**
+ * Writes the rest of the recording and closes it.
+ * @param recorder
+ * @return 0 on success, -1 with errno set if the recording is incomplete.
+ */
+int closeRecorder(Recorder *recorder) {
+    int result = flushRecorder(recorder);
+
+    if (recorder->fd != STDOUT_FILENO && close(recorder->fd) != 0)
+        result = -1;
+    free(recorder->buffer);
+    free(recorder->pieces);
+    recorder->buffer = NULL;
+    recorder->pieces = NULL;
+    return result;
+}
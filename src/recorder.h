@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "global.h"
+#include "field.h"
+
+#ifndef NC2048_RECORDER_H
+#define NC2048_RECORDER_H
+
+/*  Preallocated space for the parts of frames that change every time: timestamps, scores and messages.  */
+#define RECORDER_BUFFER_SIZE (1 << 20)
+/*  Pieces written by a single writev(). Most of them point at pre-rendered cells rather than into the buffer.  */
+#define RECORDER_PIECES 1024
+
+/*  Terminal size of the recordings: score line, empty line, the field and a message line.  */
+#define RECORDER_WIDTH 40
+#define RECORDER_HEIGHT (SIZE + 4)
+
+/*  Writes an asciicast v2 recording (https://docs.asciinema.org/manual/asciicast/v2/) of a game. Every frame
+ *  only redraws the cells and score that changed since the previous one. Frames collect in memory until the
+ *  buffer fills up or flushRecorder() is called, and go out with one writev() each time.  */
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t used;
+    struct iovec *pieces;
+    int pieceCount;
+
+    int cells[SIZE][SIZE];      /*  As last recorded, -1 before the first frame.  */
+    uint64_t score;
+    uint64_t frames;
+    int failed;                 /*  Set once a write failed, nothing is recorded afterwards.  */
+} Recorder;
+
+extern int openRecorder(Recorder *recorder, const char *path, const char *title);
+
+extern void recordFrame(Recorder *recorder, double time, Field _field, uint64_t score);
+
+extern void recordMessage(Recorder *recorder, double time, const char *message);
+
+extern int flushRecorder(Recorder *recorder);
+
+extern int closeRecorder(Recorder *recorder);
+
+#endif //NC2048_RECORDER_H
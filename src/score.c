@@ -1,15 +1,15 @@
 #include "score.h"
 
-int score = 0;
-int maxBlock = 0;
+uint64_t score = 0;
+uint64_t maxBlock = 0;
 
 /**
  * Increments the current score counter. Also updates maxBlock value where applicable.
  * @param s Score increment
  */
-void updateScore(int s) {
+void updateScore(uint64_t s) {
     score += s;
 
     if (s > maxBlock)
         maxBlock = s;
-}
\ No newline at end of file
+}
@@ -1,8 +1,10 @@
+#include <stdint.h>
+
 #ifndef NC2048_SCORE_H
 #define NC2048_SCORE_H
 
-extern int score;
-extern int maxBlock;
-extern void updateScore(int s);
+extern uint64_t score;
+extern uint64_t maxBlock;
+extern void updateScore(uint64_t s);
 
 #endif //NC2048_SCORE_H
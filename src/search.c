@@ -0,0 +1,341 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "search.h"
+
+/*  Chance paths less likely than this are evaluated instead of searched further.  */
+#define CHANCE_CUTOFF 0.0001
+/*  How often (in nodes) a cancellable search checks its generation.  */
+#define CANCEL_CHECK_INTERVAL 1024
+
+/*  Heuristic weights per row, see buildHeuristic().  */
+#define LOST_PENALTY 200000.0
+/*  A board without moves loses the LOST_PENALTY bonus of every row and column.  */
+#define DEAD_PENALTY (2 * BOARD_MAX_SIZE * LOST_PENALTY)
+#define MONOTONICITY_POWER 4.0
+#define MONOTONICITY_WEIGHT 47.0
+#define SUM_POWER 3.5
+#define SUM_WEIGHT 11.0
+#define MERGES_WEIGHT 700.0
+#define EMPTY_WEIGHT 270.0
+
+static float rowHeuristic[1 << 16];
+static pthread_once_t heuristicOnce = PTHREAD_ONCE_INIT;
+
+/*  Chance of a spawn being a 2 (exponent 1) or a 4 (exponent 2), matching populateRandomBlock().  */
+static const double spawnChance[3] = {
+        0.0,
+        (double) SPAWN_FOUR_ODDS / (SPAWN_FOUR_ODDS + 1),
+        1.0 / (SPAWN_FOUR_ODDS + 1)
+};
+
+/**
+ * Scores every possible 4-block row: empty cells and possible joins are rewarded, rows that are not
+ * monotonic and large blocks (which should be joined instead) are penalised.
+ */
+static void buildHeuristic() {
+    for (int packed = 0; packed < (1 << 16); packed++) {
+        int row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = (packed >> (4 * i)) & 0xF;
+
+        double sum = 0;
+        int empty = 0;
+        int merges = 0;
+        int previous = 0;
+        int counter = 0;
+
+        for (int i = 0; i < 4; i++) {
+            sum += pow(row[i], SUM_POWER);
+            if (row[i] == 0) {
+                empty++;
+                continue;
+            }
+
+            if (previous == row[i]) {
+                counter++;
+            } else if (counter > 0) {
+                merges += 1 + counter;
+                counter = 0;
+            }
+            previous = row[i];
+        }
+        if (counter > 0)
+            merges += 1 + counter;
+
+        double monotonicLeft = 0;
+        double monotonicRight = 0;
+        for (int i = 1; i < 4; i++) {
+            double left = pow(row[i - 1], MONOTONICITY_POWER);
+            double right = pow(row[i], MONOTONICITY_POWER);
+            if (row[i - 1] > row[i])
+                monotonicLeft += left - right;
+            else
+                monotonicRight += right - left;
+        }
+
+        rowHeuristic[packed] = (float) (LOST_PENALTY
+                                        + EMPTY_WEIGHT * empty
+                                        + MERGES_WEIGHT * merges
+                                        - MONOTONICITY_WEIGHT * fmin(monotonicLeft, monotonicRight)
+                                        - SUM_WEIGHT * sum);
+    }
+}
+
+/**
+ * Prepares a search. Also builds the board tables if needed.
+ * @param search
+ * @param tableBits Transposition table size as a power of two of entries, 0 to search without one.
+ * @return 0 on success, -1 if the table could not be allocated.
+ */
+int initSearch(Search *search, int tableBits) {
+    initBoardTables();
+    pthread_once(&heuristicOnce, buildHeuristic);
+
+    search->generation = NULL;
+    search->expected = 0;
+    search->cancelled = false;
+    search->nodes = 0;
+    search->table = NULL;
+    search->tableMask = 0;
+    search->tableGeneration = 1;    /*  Fresh memory is zeroed, generation 0 never matches.  */
+
+    if (tableBits > 0) {
+        size_t entries = (size_t) 1 << tableBits;
+        // Left to first touch: the searching thread is usually not the one that sets it up.
+        if (allocTableMemory(&search->tableMemory, "transposition tables", entries * sizeof(TranspositionEntry),
+                             NODE_FIRST_TOUCH) != 0)
+            return -1;
+        search->table = search->tableMemory.memory;
+        search->tableMask = entries - 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Releases the memory held by a search.
+ * @param search
+ */
+void freeSearch(Search *search) {
+    if (search->table != NULL)
+        freeTableMemory(&search->tableMemory);
+    search->table = NULL;
+    search->tableMask = 0;
+}
+
+/**
+ * Forgets every transposition table entry, so the next search doesn't depend on the ones before it.
+ * @param search
+ */
+void clearSearchTable(Search *search) {
+    if (search->table == NULL)
+        return;
+    if (++search->tableGeneration == 0) {
+        memset(search->table, 0, (search->tableMask + 1) * sizeof(TranspositionEntry));
+        search->tableGeneration = 1;
+    }
+}
+
+/**
+ * Heuristic value of a 4x4 board, higher is better.
+ * @param board
+ * @return
+ */
+double evaluateBoard(Board board) {
+    Board transposed = boardTranspose(board);
+    double value = 0;
+
+    for (int i = 0; i < 4; i++) {
+        value += rowHeuristic[(board >> (16 * i)) & 0xFFFF];
+        value += rowHeuristic[(transposed >> (16 * i)) & 0xFFFF];
+    }
+    return value;
+}
+
+static uint64_t hashBoard(Board board) {
+    board ^= board >> 33;
+    board *= 0xFF51AFD7ED558CCDULL;
+    board ^= board >> 33;
+    return board;
+}
+
+static int isCancelled(Search *search) {
+    if (search->generation != NULL && (search->nodes % CANCEL_CHECK_INTERVAL) == 0
+        && __atomic_load_n(search->generation, __ATOMIC_RELAXED) != search->expected)
+        search->cancelled = true;
+    return search->cancelled;
+}
+
+static double searchMove(Search *search, Board board, int depth, double chance, double *score);
+
+/**
+ * Expected value over every spawn on a board the player just moved.
+ */
+static double searchSpawn(Search *search, Board board, int depth, double chance, double *score) {
+    search->nodes++;
+
+    if (depth == 0 || chance < CHANCE_CUTOFF || isCancelled(search)) {
+        *score = 0;
+        return evaluateBoard(board);
+    }
+
+    TranspositionEntry *entry = NULL;
+    if (search->table != NULL) {
+        entry = &search->table[hashBoard(board) & search->tableMask];
+        if (entry->board == board && entry->generation == search->tableGeneration
+            && entry->depth >= (uint32_t) depth) {
+            *score = entry->score;
+            return entry->value;
+        }
+    }
+
+    int empty = boardEmptyCount(board, SIZE);
+    double value = 0;
+    double expected = 0;
+
+    for (int shift = 0; shift < 4 * SIZE * BOARD_MAX_SIZE; shift += 4) {
+        if (((board >> shift) & 0xF) != 0 || (shift % (4 * BOARD_MAX_SIZE)) >= 4 * SIZE)
+            continue;
+
+        for (int spawn = 1; spawn <= 2; spawn++) {
+            double spawnWeight = spawnChance[spawn] / empty;
+            double childScore;
+            value += spawnWeight * searchMove(search, board | ((Board) spawn << shift), depth,
+                                              chance * spawnWeight, &childScore);
+            expected += spawnWeight * childScore;
+        }
+    }
+
+    // Don't cache values of an interrupted search, they are incomplete.
+    if (entry != NULL && !search->cancelled) {
+        entry->board = board;
+        entry->value = (float) value;
+        entry->score = (float) expected;
+        entry->depth = (uint32_t) depth;
+        entry->generation = search->tableGeneration;
+    }
+
+    *score = expected;
+    return value;
+}
+
+/**
+ * Best value over every move of a board the player has to move on.
+ */
+static double searchMove(Search *search, Board board, int depth, double chance, double *score) {
+    double best = 0;
+    double bestScore = 0;
+    int moved = false;
+
+    search->nodes++;
+
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        int gained;
+        Board next = boardMove(board, dir, &gained);
+        if (next == board)
+            continue;
+
+        double childScore;
+        double value = searchSpawn(search, next, depth - 1, chance, &childScore);
+        if (!moved || value > best) {
+            best = value;
+            bestScore = gained + childScore;
+            moved = true;
+        }
+    }
+
+    // Lost: worse than any board that can still move, on the scale of the live evaluations.
+    if (!moved)
+        best = evaluateBoard(board) - DEAD_PENALTY;
+
+    *score = bestScore;
+    return best;
+}
+
+/**
+ * Runs a single expectimax search of fixed depth.
+ * @param search
+ * @param board 4x4 board the player has to move on.
+ * @param depth Number of moves to look ahead, at least 1.
+ * @param result Receives the outcome, untouched if the search was cancelled.
+ * @return true(1) if the search completed, false(0) if it was cancelled.
+ */
+int searchBoard(Search *search, Board board, int depth, SearchResult *result) {
+    double values[DIR_COUNT];
+    double scores[DIR_COUNT];
+    int legal[DIR_COUNT];
+    int best = DIR_NONE;
+    uint64_t nodes = search->nodes;
+
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        int gained;
+        Board moved = boardMove(board, dir, &gained);
+        values[dir] = 0;
+        scores[dir] = 0;
+        legal[dir] = (moved != board);
+        if (moved == board)
+            continue;
+
+        values[dir] = searchSpawn(search, moved, depth - 1, 1.0, &scores[dir]);
+        scores[dir] += gained;
+        if (search->cancelled)
+            return false;
+
+        if (best == DIR_NONE || values[dir] > values[best])
+            best = dir;
+    }
+
+    /*  Lead over the runner-up relative to the spread of the legal moves. Heuristic values carry a large
+     *  constant offset, so measured against the value itself every lead would look like 0%.  */
+    int moves = 0;
+    int runnerUp = DIR_NONE;
+    int worst = DIR_NONE;
+    for (int dir = 0; dir < DIR_COUNT; dir++) {
+        if (!legal[dir])
+            continue;
+        if (dir != best && (runnerUp == DIR_NONE || values[dir] > values[runnerUp]))
+            runnerUp = dir;
+        if (worst == DIR_NONE || values[dir] < values[worst])
+            worst = dir;
+        moves++;
+    }
+
+    result->move = best;
+    result->depth = depth;
+    result->value = (best != DIR_NONE) ? values[best] : 0;
+    result->score = (best != DIR_NONE) ? scores[best] : 0;
+    if (moves == 1)
+        result->confidence = 1.0;
+    else if (moves > 1 && values[best] > values[worst])
+        result->confidence = (values[best] - values[runnerUp]) / (values[best] - values[worst]);
+    else
+        result->confidence = 0;
+    result->nodes = search->nodes - nodes;
+    return true;
+}
+
+/**
+ * Searches with increasing depth up to <i>maxDepth</i>. Shallower results fill the transposition table
+ * for the deeper ones.
+ * @param search
+ * @param board
+ * @param maxDepth
+ * @param result Receives the deepest completed search. Nodes are summed over all depths.
+ * @return true(1) if at least one depth completed, false(0) otherwise.
+ */
+int searchBoardDeepening(Search *search, Board board, int maxDepth, SearchResult *result) {
+    uint64_t nodes = search->nodes;
+    int completed = false;
+
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        if (searchBoard(search, board, depth, result) == false)
+            break;
+        completed = true;
+    }
+
+    result->nodes = search->nodes - nodes;
+    return completed;
+}
@@ -0,0 +1,60 @@
+#include <stdint.h>
+
+#include "board.h"
+#include "placement.h"
+
+#ifndef NC2048_SEARCH_H
+#define NC2048_SEARCH_H
+
+/*  Deepest search depth (in moves) the iterative deepening loops go to.  */
+#define SEARCH_MAX_DEPTH 8
+/*  Default size of a search's transposition table, as a power of two of entries.  */
+#define SEARCH_TABLE_BITS 20
+
+typedef struct {
+    Board board;
+    float value;
+    float score;
+    uint32_t depth;
+    uint32_t generation;            /*  Entries of other generations are treated as empty.  */
+} TranspositionEntry;
+
+/*  State of one searching thread. Never shared between threads.  */
+typedef struct {
+    /*  Optional cancellation: the search stops once *generation no longer equals expected.  */
+    const unsigned *generation;
+    unsigned expected;
+    int cancelled;
+
+    uint64_t nodes;
+
+    TranspositionEntry *table;
+    uint64_t tableMask;
+    uint32_t tableGeneration;
+    TableMemory tableMemory;
+} Search;
+
+typedef struct {
+    int move;                       /*  Best move, DIR_NONE if the board can't move.                */
+    int depth;                      /*  Depth the result was searched to.                           */
+    double value;                   /*  Heuristic value of the best move.                           */
+    double score;                   /*  Expected score gained within <i>depth</i> moves.             */
+    double confidence;              /*  Lead of the best move over the runner-up, relative to its lead
+                                     *  over the worst move: 0 (tie) to 1. Always 1 with one or two
+                                     *  legal moves.                                                  */
+    uint64_t nodes;                 /*  Nodes visited by this search.                                */
+} SearchResult;
+
+extern int initSearch(Search *search, int tableBits);
+
+extern void freeSearch(Search *search);
+
+extern void clearSearchTable(Search *search);
+
+extern double evaluateBoard(Board board);
+
+extern int searchBoard(Search *search, Board board, int depth, SearchResult *result);
+
+extern int searchBoardDeepening(Search *search, Board board, int maxDepth, SearchResult *result);
+
+#endif //NC2048_SEARCH_H
@@ -0,0 +1,516 @@
+#define _GNU_SOURCE
+
+#include <endian.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "server.h"
+
+/*  Session ids hold the slot in the owning shard's pool in the low 24 bits, the shard in the next 8 bits and
+ *  the slot's generation in the high 32 bits. The generation changes whenever a slot is freed, so the id of an
+ *  ended game never finds the game that reuses its slot.  */
+#define SHARD_SHIFT 24
+#define GENERATION_SHIFT 32
+#define SESSION_MASK ((1u << SHARD_SHIFT) - 1)
+#define SHARD_MASK 0xFFu
+#define MAX_SHARDS 256
+#define NO_SESSION_SLOT UINT32_MAX
+
+/*  Per connection buffers. A client that doesn't read its responses stops being read from once the output
+ *  buffer is full.  */
+#define INPUT_BUFFER_SIZE (sizeof(Request) * 256)
+#define OUTPUT_BUFFER_SIZE (sizeof(Response) * 1024)
+#define MAX_EVENTS 256
+
+/*
+ * Every shard runs its own epoll loop on its own thread and accepts from the shared listening socket. A
+ * connection stays on the shard that accepted it and its games live in that shard's session pool, so shards
+ * never share state and need no locks.
+ */
+
+typedef struct Connection Connection;
+
+typedef struct {
+    Board board;
+    uint64_t score;
+    Rng rng;
+    Connection *owner;      /*  NULL while the slot is free.                                   */
+    uint32_t moves;
+    uint32_t generation;
+    uint32_t next;          /*  Next slot of the owner's sessions, or next free slot while free.  */
+    uint32_t previous;      /*  Previous slot of the owner's sessions.                         */
+} Session;
+
+struct Connection {
+    int fd;
+    uint32_t events;
+    Connection *previous;
+    Connection *next;
+    uint32_t firstSession;  /*  Sessions of this connection, linked through their slots.  */
+
+    size_t inputLength;
+    size_t outputLength;
+    unsigned char input[INPUT_BUFFER_SIZE];
+    unsigned char output[OUTPUT_BUFFER_SIZE];
+};
+
+typedef struct {
+    uint32_t index;
+    int epoll;
+    int listener;
+    int stopEvent;
+    pthread_t thread;
+    Rng seeds;
+
+    Connection *connections;
+
+    Session *sessions;
+    uint32_t sessionCount;
+    uint32_t sessionCapacity;
+    uint32_t freeSession;
+} Shard;
+
+/*  epoll tags of the two non-connection descriptors.  */
+static int listenerTag;
+static int stopTag;
+
+static uint32_t allocateSession(Shard *shard, Connection *owner) {
+    uint32_t slot = shard->freeSession;
+
+    if (slot != NO_SESSION_SLOT) {
+        shard->freeSession = shard->sessions[slot].next;
+    } else {
+        if (shard->sessionCount == shard->sessionCapacity) {
+            uint32_t capacity = (shard->sessionCapacity == 0) ? 1024 : shard->sessionCapacity * 2;
+            if (capacity > SESSION_MASK + 1)
+                return NO_SESSION_SLOT;
+
+            Session *sessions = realloc(shard->sessions, capacity * sizeof(Session));
+            if (sessions == NULL)
+                return NO_SESSION_SLOT;
+            shard->sessions = sessions;
+            shard->sessionCapacity = capacity;
+        }
+        slot = shard->sessionCount++;
+        shard->sessions[slot].generation = 0;
+    }
+
+    Session *session = &shard->sessions[slot];
+    session->owner = owner;
+    session->previous = NO_SESSION_SLOT;
+    session->next = owner->firstSession;
+    if (owner->firstSession != NO_SESSION_SLOT)
+        shard->sessions[owner->firstSession].previous = slot;
+    owner->firstSession = slot;
+    return slot;
+}
+
+static void freeSession(Shard *shard, uint32_t slot) {
+    Session *session = &shard->sessions[slot];
+    Connection *owner = session->owner;
+
+    if (session->previous != NO_SESSION_SLOT)
+        shard->sessions[session->previous].next = session->next;
+    else
+        owner->firstSession = session->next;
+    if (session->next != NO_SESSION_SLOT)
+        shard->sessions[session->next].previous = session->previous;
+
+    session->owner = NULL;
+    session->generation++;
+    session->next = shard->freeSession;
+    shard->freeSession = slot;
+}
+
+static uint64_t sessionId(const Shard *shard, uint32_t slot) {
+    return ((uint64_t) shard->sessions[slot].generation << GENERATION_SHIFT)
+           | ((uint64_t) shard->index << SHARD_SHIFT) | slot;
+}
+
+static Session *findSession(Shard *shard, Connection *connection, uint64_t id) {
+    uint32_t slot = (uint32_t) id & SESSION_MASK;
+
+    if (((id >> SHARD_SHIFT) & SHARD_MASK) != shard->index || slot >= shard->sessionCount
+        || shard->sessions[slot].owner != connection
+        || shard->sessions[slot].generation != (uint32_t) (id >> GENERATION_SHIFT))
+        return NULL;
+    return &shard->sessions[slot];
+}
+
+/**
+ * Checks whether any move is left that changes the board and stays within the packed board.
+ */
+static int isGameOver(Board board) {
+    for (int dir = 0; dir < DIR_COUNT; dir++)
+        if (boardMoveOverflows(board, dir, SIZE) == false && boardMove(board, dir, NULL) != board)
+            return false;
+    return true;
+}
+
+static void handleRequest(Shard *shard, Connection *connection, const Request *request, Response *response) {
+    uint64_t id = le64toh(request->session);
+    Session *session = NULL;
+
+    memset(response, 0, sizeof(Response));
+
+    switch (request->op) {
+        case OP_NEW: {
+            uint32_t slot = allocateSession(shard, connection);
+            if (slot == NO_SESSION_SLOT) {
+                response->status = STATUS_BAD_REQUEST;
+                return;
+            }
+
+            uint64_t seed = le64toh(request->seed);
+            session = &shard->sessions[slot];
+            seedRng(&session->rng, (seed != 0) ? seed : nextRng(&shard->seeds));
+            session->board = boardNew(SIZE, &session->rng);
+            session->score = 0;
+            session->moves = 0;
+            id = sessionId(shard, slot);
+            break;
+        }
+        case OP_MOVE: {
+            session = findSession(shard, connection, id);
+            if (session == NULL)
+                break;
+            if (request->dir >= DIR_COUNT) {
+                response->status = STATUS_BAD_REQUEST;
+                return;
+            }
+
+            if (boardMoveOverflows(session->board, request->dir, SIZE)) {
+                response->flags |= FLAG_AT_LIMIT;
+                break;
+            }
+
+            int gained;
+            Board moved = boardMove(session->board, request->dir, &gained);
+            if (moved != session->board) {
+                session->board = boardSpawn(moved, SIZE, &session->rng);
+                session->score += (uint64_t) gained;
+                session->moves++;
+                response->flags |= FLAG_MOVED;
+            }
+            break;
+        }
+        case OP_STATE:
+        case OP_END:
+            session = findSession(shard, connection, id);
+            break;
+        default:
+            response->status = STATUS_BAD_REQUEST;
+            return;
+    }
+
+    if (session == NULL) {
+        response->status = STATUS_NO_SESSION;
+        return;
+    }
+
+    response->status = STATUS_OK;
+    response->session = htole64(id);
+    response->moves = htole32(session->moves);
+    response->board = htole64(session->board);
+    response->score = htole64(session->score);
+    if (isGameOver(session->board))
+        response->flags |= FLAG_GAME_OVER;
+
+    if (request->op == OP_END)
+        freeSession(shard, (uint32_t) id & SESSION_MASK);
+}
+
+static void closeConnection(Shard *shard, Connection *connection) {
+    epoll_ctl(shard->epoll, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+
+    while (connection->firstSession != NO_SESSION_SLOT)
+        freeSession(shard, connection->firstSession);
+
+    if (connection->previous != NULL)
+        connection->previous->next = connection->next;
+    else
+        shard->connections = connection->next;
+    if (connection->next != NULL)
+        connection->next->previous = connection->previous;
+
+    free(connection);
+}
+
+/**
+ * Answers every complete request in the input buffer, as long as the output buffer has room.
+ * @return Number of requests handled.
+ */
+static size_t handleRequests(Shard *shard, Connection *connection) {
+    size_t offset = 0;
+    size_t handled = 0;
+
+    while (connection->inputLength - offset >= sizeof(Request)
+           && connection->outputLength + sizeof(Response) <= sizeof(connection->output)) {
+        Request request;
+        Response response;
+
+        memcpy(&request, connection->input + offset, sizeof(Request));
+        handleRequest(shard, connection, &request, &response);
+        memcpy(connection->output + connection->outputLength, &response, sizeof(Response));
+
+        connection->outputLength += sizeof(Response);
+        offset += sizeof(Request);
+        handled++;
+    }
+
+    connection->inputLength -= offset;
+    memmove(connection->input, connection->input + offset, connection->inputLength);
+    return handled;
+}
+
+/**
+ * Writes as much of the output buffer as the socket takes.
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int flushOutput(Connection *connection) {
+    size_t sent = 0;
+
+    while (sent < connection->outputLength) {
+        ssize_t written = send(connection->fd, connection->output + sent, connection->outputLength - sent,
+                               MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+        sent += (size_t) written;
+    }
+
+    connection->outputLength -= sent;
+    memmove(connection->output, connection->output + sent, connection->outputLength);
+    return 0;
+}
+
+/**
+ * Reads, answers and writes until the connection has nothing more to do right now.
+ */
+static void serviceConnection(Shard *shard, Connection *connection) {
+    for (;;) {
+        ssize_t received = 0;
+
+        if (connection->inputLength < sizeof(connection->input)) {
+            received = recv(connection->fd, connection->input + connection->inputLength,
+                            sizeof(connection->input) - connection->inputLength, 0);
+            if (received == 0) {
+                closeConnection(shard, connection);
+                return;
+            }
+            if (received < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    closeConnection(shard, connection);
+                    return;
+                }
+                received = 0;
+            }
+            connection->inputLength += (size_t) received;
+        }
+
+        size_t handled = handleRequests(shard, connection);
+        if (flushOutput(connection) != 0) {
+            closeConnection(shard, connection);
+            return;
+        }
+
+        if (received == 0 && handled == 0)
+            break;
+    }
+
+    /*  Wait for the socket to drain before reading more from a client that doesn't read.  */
+    uint32_t events = 0;
+    if (connection->outputLength > 0)
+        events |= EPOLLOUT;
+    if (connection->outputLength + sizeof(Response) <= sizeof(connection->output))
+        events |= EPOLLIN;
+
+    if (events != connection->events) {
+        struct epoll_event event = {.events = events, .data.ptr = connection};
+        epoll_ctl(shard->epoll, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+static void acceptConnections(Shard *shard) {
+    for (;;) {
+        int fd = accept4(shard->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;     /*  EAGAIN: another shard took it, or no more pending.  */
+
+        Connection *connection = malloc(sizeof(Connection));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        connection->inputLength = 0;
+        connection->outputLength = 0;
+        connection->firstSession = NO_SESSION_SLOT;
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+        if (epoll_ctl(shard->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(connection);
+            continue;
+        }
+
+        connection->previous = NULL;
+        connection->next = shard->connections;
+        if (shard->connections != NULL)
+            shard->connections->previous = connection;
+        shard->connections = connection;
+    }
+}
+
+static void *runShard(void *arg) {
+    Shard *shard = arg;
+    struct epoll_event events[MAX_EVENTS];
+    int running = true;
+
+    initBoardTables();
+    while (running) {
+        int count = epoll_wait(shard->epoll, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listenerTag)
+                acceptConnections(shard);
+            else if (tag == &stopTag)
+                running = false;
+            else
+                serviceConnection(shard, tag);
+        }
+    }
+
+    while (shard->connections != NULL)
+        closeConnection(shard, shard->connections);
+    return NULL;
+}
+
+static int initShard(Shard *shard, uint32_t index, int listener, int stopEvent) {
+    memset(shard, 0, sizeof(Shard));
+    shard->index = index;
+    shard->listener = listener;
+    shard->stopEvent = stopEvent;
+    shard->freeSession = NO_SESSION_SLOT;
+    seedRng(&shard->seeds, (uint64_t) time(NULL) ^ ((uint64_t) index << 32));
+
+    shard->epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (shard->epoll < 0)
+        return -1;
+
+    /*  Only wake one shard per incoming connection.  */
+    struct epoll_event listen = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &listenerTag};
+    struct epoll_event stop = {.events = EPOLLIN, .data.ptr = &stopTag};
+    if (epoll_ctl(shard->epoll, EPOLL_CTL_ADD, listener, &listen) != 0
+        || epoll_ctl(shard->epoll, EPOLL_CTL_ADD, stopEvent, &stop) != 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * Serves games on a Unix domain socket until SIGINT or SIGTERM is received.
+ * @param path Socket path. An existing file at this path is replaced.
+ * @param shards Number of event loop threads, 1 to 256.
+ * @return 0 after a clean shutdown, -1 on failure with errno set.
+ */
+int runServer(const char *path, int shards) {
+    struct sockaddr_un address;
+
+    if (shards < 1 || shards > MAX_SHARDS || strlen(path) >= sizeof(address.sun_path)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    initBoardTables();
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+        return -1;
+
+    unlink(path);
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        close(listener);
+        return -1;
+    }
+
+    int stopEvent = eventfd(0, EFD_CLOEXEC);
+    if (stopEvent < 0) {
+        close(listener);
+        return -1;
+    }
+
+    /*  Signals are only taken by sigwait() below, the shards never see them.  */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    Shard *pool = calloc((size_t) shards, sizeof(Shard));
+    int started = 0;
+    int result = 0;
+
+    if (pool == NULL)
+        result = -1;
+    for (; result == 0 && started < shards; started++) {
+        if (initShard(&pool[started], (uint32_t) started, listener, stopEvent) != 0
+            || pthread_create(&pool[started].thread, NULL, runShard, &pool[started]) != 0) {
+            if (pool[started].epoll > 0)
+                close(pool[started].epoll);
+            result = -1;
+            break;
+        }
+    }
+
+    if (result == 0) {
+        int signal;
+        sigwait(&signals, &signal);
+    }
+    int error = errno;
+
+    uint64_t stop = 1;
+    if (write(stopEvent, &stop, sizeof(stop)) != sizeof(stop))
+        result = -1;
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool[i].thread, NULL);
+        close(pool[i].epoll);
+        free(pool[i].sessions);
+    }
+
+    free(pool);
+    close(stopEvent);
+    close(listener);
+    unlink(path);
+
+    errno = error;
+    return result;
+}
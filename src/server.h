@@ -0,0 +1,54 @@
+#include <stdint.h>
+
+#include "board.h"
+
+#ifndef NC2048_SERVER_H
+#define NC2048_SERVER_H
+
+/*
+ * Wire protocol of nc2048-server. Clients send fixed size requests and receive one fixed size response per
+ * request, in request order. All integers are little-endian. Clients may send any number of requests before
+ * reading the responses.
+ *
+ * Boards are sent packed, 4 bits per block exponent, so games end at the packed board's limit: a move that would
+ * join two 32768 blocks (exponent BOARD_MAX_EXPONENT) is refused with FLAG_AT_LIMIT, and a game where no other move
+ * is left is over. Endless games past 32768 are only played locally (nc2048 -e, nc2048-sim).
+ */
+
+#define OP_NEW 1            /*  Starts a game. <i>seed</i> seeds its spawns, 0 picks a seed.  */
+#define OP_MOVE 2           /*  Moves the game <i>session</i> in direction <i>dir</i> (DIR_*). */
+#define OP_STATE 3          /*  Reports the state of game <i>session</i>.                       */
+#define OP_END 4            /*  Ends game <i>session</i> and frees it.                          */
+
+#define STATUS_OK 0
+#define STATUS_NO_SESSION 1 /*  Unknown or ended session, or owned by another connection.  */
+#define STATUS_BAD_REQUEST 2
+
+#define FLAG_MOVED 1        /*  The move changed the board.                */
+#define FLAG_GAME_OVER 2    /*  No move can change the board any more.    */
+#define FLAG_AT_LIMIT 4     /*  The move was refused, it would join two blocks at BOARD_MAX_EXPONENT.  */
+
+/*  Session ids are opaque to clients. An id stays invalid once its game has ended, even after the server
+ *  reuses the game's memory for a new game.  */
+typedef struct {
+    uint8_t op;
+    uint8_t dir;
+    uint16_t reserved;
+    uint32_t reserved2;
+    uint64_t session;
+    uint64_t seed;
+} Request;
+
+typedef struct {
+    uint8_t status;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t moves;
+    uint64_t session;
+    uint64_t board;         /*  Packed Board.  */
+    uint64_t score;
+} Response;
+
+extern int runServer(const char *path, int shards);
+
+#endif //NC2048_SERVER_H
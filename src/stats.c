@@ -0,0 +1,372 @@
+#include <math.h>
+#include <string.h>
+
+#include "stats.h"
+
+/*  Quantiles listed in the reports.  */
+static const double reportQuantiles[] = {0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999};
+#define REPORT_QUANTILES (sizeof(reportQuantiles) / sizeof(reportQuantiles[0]))
+/*  Block exponents whose reach rate is reported. (11 -> 2048)  */
+static const int reportReach[] = {11, 12, 13, 14, 15};
+#define REPORT_REACH (sizeof(reportReach) / sizeof(reportReach[0]))
+
+static void initSketch(Sketch *sketch) {
+    memset(sketch, 0, sizeof(Sketch));
+    sketch->min = INFINITY;
+    sketch->max = -INFINITY;
+}
+
+static void addSketch(Sketch *sketch, double value) {
+    int index = 0;
+    if (value > 1.0) {
+        index = 1 + (int) ceil(log(value) / log(SKETCH_GAMMA));
+        if (index >= SKETCH_BUCKETS)
+            index = SKETCH_BUCKETS - 1;
+    } else if (value > 0) {
+        index = 1;
+    }
+
+    sketch->buckets[index]++;
+    sketch->count++;
+    sketch->sum += value;
+    if (value < sketch->min)
+        sketch->min = value;
+    if (value > sketch->max)
+        sketch->max = value;
+}
+
+static void mergeSketch(Sketch *into, const Sketch *from) {
+    for (int i = 0; i < SKETCH_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+}
+
+/**
+ * Estimates a quantile, within 1% of the exact value if that is 0 or at least 1.
+ * @param sketch
+ * @param quantile 0 to 1.
+ * @return The estimate, 0 if the sketch is empty.
+ */
+double sketchQuantile(const Sketch *sketch, double quantile) {
+    if (sketch->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (quantile * (double) (sketch->count - 1));
+    uint64_t seen = 0;
+    int index = 0;
+
+    for (; index < SKETCH_BUCKETS - 1; index++) {
+        seen += sketch->buckets[index];
+        if (seen > rank)
+            break;
+    }
+
+    /*  Middle of the bucket (relative to its width), clamped to what was actually seen.  */
+    double value = 0;
+    if (index == 1)
+        value = 1.0;
+    else if (index > 1)
+        value = 2.0 * pow(SKETCH_GAMMA, index - 1) / (SKETCH_GAMMA + 1.0);
+    if (value < sketch->min)
+        value = sketch->min;
+    if (value > sketch->max)
+        value = sketch->max;
+    return value;
+}
+
+/**
+ * Resets the statistics.
+ * @param stats
+ */
+void initStats(Stats *stats) {
+    stats->games = 0;
+    stats->moves = 0;
+    stats->seconds = 0;
+    initSketch(&stats->score);
+    initSketch(&stats->length);
+    initSketch(&stats->speed);
+    memset(stats->maxTiles, 0, sizeof(stats->maxTiles));
+}
+
+/**
+ * Adds the outcome of one game.
+ * @param stats
+ * @param game
+ */
+void addGame(Stats *stats, const GameResult *game) {
+    stats->games++;
+    stats->moves += game->moves;
+    stats->seconds += game->seconds;
+
+    addSketch(&stats->score, (double) game->score);
+    addSketch(&stats->length, game->moves);
+    if (game->seconds > 0)
+        addSketch(&stats->speed, game->moves / game->seconds);
+
+    int tile = (game->maxExponent < TILE_BUCKETS) ? game->maxExponent : TILE_BUCKETS - 1;
+    stats->maxTiles[tile]++;
+}
+
+/**
+ * Adds all games of <i>from</i> to <i>into</i>, as if they had been added there directly.
+ * @param into
+ * @param from
+ */
+void mergeStats(Stats *into, const Stats *from) {
+    into->games += from->games;
+    into->moves += from->moves;
+    into->seconds += from->seconds;
+    mergeSketch(&into->score, &from->score);
+    mergeSketch(&into->length, &from->length);
+    mergeSketch(&into->speed, &from->speed);
+    for (int i = 0; i < TILE_BUCKETS; i++)
+        into->maxTiles[i] += from->maxTiles[i];
+}
+
+/**
+ * @param stats
+ * @param exponent
+ * @return Share of games that made a block of at least 2^<i>exponent</i>.
+ */
+double reachRate(const Stats *stats, int exponent) {
+    uint64_t reached = 0;
+    for (int i = exponent; i < TILE_BUCKETS; i++)
+        reached += stats->maxTiles[i];
+    return (stats->games > 0) ? (double) reached / (double) stats->games : 0;
+}
+
+static void writeSketchJson(FILE *out, const char *name, const Sketch *sketch) {
+    fprintf(out, "  \"%s\": {\"mean\": %.3f, \"min\": %.3f, \"max\": %.3f", name,
+            (sketch->count > 0) ? sketch->sum / (double) sketch->count : 0.0,
+            (sketch->count > 0) ? sketch->min : 0.0, (sketch->count > 0) ? sketch->max : 0.0);
+    for (size_t i = 0; i < REPORT_QUANTILES; i++)
+        fprintf(out, ", \"p%g\": %.3f", reportQuantiles[i] * 100.0, sketchQuantile(sketch, reportQuantiles[i]));
+    fprintf(out, "},\n");
+}
+
+/**
+ * Writes the statistics as a JSON object.
+ * @param out
+ * @param stats
+ * @param wallSeconds Wall clock duration of the run.
+ */
+void writeStatsJson(FILE *out, const Stats *stats, double wallSeconds) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"games\": %llu,\n", (unsigned long long) stats->games);
+    fprintf(out, "  \"moves\": %llu,\n", (unsigned long long) stats->moves);
+    fprintf(out, "  \"seconds\": %.3f,\n", wallSeconds);
+    fprintf(out, "  \"games_per_second\": %.3f,\n", (wallSeconds > 0) ? (double) stats->games / wallSeconds : 0.0);
+    fprintf(out, "  \"moves_per_second\": %.3f,\n", (wallSeconds > 0) ? (double) stats->moves / wallSeconds : 0.0);
+
+    writeSketchJson(out, "score", &stats->score);
+    writeSketchJson(out, "length", &stats->length);
+    writeSketchJson(out, "game_moves_per_second", &stats->speed);
+
+    fprintf(out, "  \"max_tile\": {");
+    int first = true;
+    for (int i = 0; i < TILE_BUCKETS; i++) {
+        if (stats->maxTiles[i] == 0)
+            continue;
+        fprintf(out, "%s\"%llu\": %llu", first ? "" : ", ", 1ULL << i, (unsigned long long) stats->maxTiles[i]);
+        first = false;
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"reach\": {");
+    for (size_t i = 0; i < REPORT_REACH; i++)
+        fprintf(out, "%s\"%llu\": %.6f", (i == 0) ? "" : ", ", 1ULL << reportReach[i],
+                reachRate(stats, reportReach[i]));
+    fprintf(out, "}\n}\n");
+}
+
+static void writeSketchCsv(FILE *out, const char *name, const Sketch *sketch) {
+    fprintf(out, "%s_mean,%.3f\n", name, (sketch->count > 0) ? sketch->sum / (double) sketch->count : 0.0);
+    fprintf(out, "%s_min,%.3f\n", name, (sketch->count > 0) ? sketch->min : 0.0);
+    fprintf(out, "%s_max,%.3f\n", name, (sketch->count > 0) ? sketch->max : 0.0);
+    for (size_t i = 0; i < REPORT_QUANTILES; i++)
+        fprintf(out, "%s_p%g,%.3f\n", name, reportQuantiles[i] * 100.0, sketchQuantile(sketch, reportQuantiles[i]));
+}
+
+/**
+ * Writes the statistics as "metric,value" CSV rows.
+ * @param out
+ * @param stats
+ * @param wallSeconds Wall clock duration of the run.
+ */
+void writeStatsCsv(FILE *out, const Stats *stats, double wallSeconds) {
+    fprintf(out, "metric,value\n");
+    fprintf(out, "games,%llu\n", (unsigned long long) stats->games);
+    fprintf(out, "moves,%llu\n", (unsigned long long) stats->moves);
+    fprintf(out, "seconds,%.3f\n", wallSeconds);
+    fprintf(out, "games_per_second,%.3f\n", (wallSeconds > 0) ? (double) stats->games / wallSeconds : 0.0);
+    fprintf(out, "moves_per_second,%.3f\n", (wallSeconds > 0) ? (double) stats->moves / wallSeconds : 0.0);
+
+    writeSketchCsv(out, "score", &stats->score);
+    writeSketchCsv(out, "length", &stats->length);
+    writeSketchCsv(out, "game_moves_per_second", &stats->speed);
+
+    for (int i = 0; i < TILE_BUCKETS; i++)
+        if (stats->maxTiles[i] != 0)
+            fprintf(out, "max_tile_%llu,%llu\n", 1ULL << i, (unsigned long long) stats->maxTiles[i]);
+    for (size_t i = 0; i < REPORT_REACH; i++)
+        fprintf(out, "reach_%llu,%.6f\n", 1ULL << reportReach[i], reachRate(stats, reportReach[i]));
+}
+
+/**
+ * Resets paired statistics.
+ * @param paired
+ */
+void initPairedStats(PairedStats *paired) {
+    memset(paired, 0, sizeof(PairedStats));
+}
+
+/**
+ * Adds the scores of both policies on one game (Welford's method).
+ * @param paired
+ * @param a Score of policy A.
+ * @param b Score of policy B.
+ */
+void addPair(PairedStats *paired, double a, double b) {
+    double values[3] = {a, b, a - b};
+
+    paired->count++;
+    for (int i = 0; i < 3; i++) {
+        double delta = values[i] - paired->mean[i];
+        paired->mean[i] += delta / (double) paired->count;
+        paired->m2[i] += delta * (values[i] - paired->mean[i]);
+    }
+}
+
+/**
+ * Adds all pairs of <i>from</i> to <i>into</i> (Chan et al.'s parallel variance).
+ * @param into
+ * @param from
+ */
+void mergePairedStats(PairedStats *into, const PairedStats *from) {
+    if (from->count == 0)
+        return;
+
+    double count = (double) (into->count + from->count);
+    for (int i = 0; i < 3; i++) {
+        double delta = from->mean[i] - into->mean[i];
+        into->mean[i] += delta * (double) from->count / count;
+        into->m2[i] += from->m2[i] + delta * delta * (double) into->count * (double) from->count / count;
+    }
+    into->count += from->count;
+}
+
+static double variance(const PairedStats *paired, int index) {
+    return (paired->count > 1) ? paired->m2[index] / (double) (paired->count - 1) : 0;
+}
+
+/**
+ * @param paired
+ * @return Standard error of the mean score difference.
+ */
+double pairedStandardError(const PairedStats *paired) {
+    return (paired->count > 1) ? sqrt(variance(paired, 2) / (double) paired->count) : INFINITY;
+}
+
+/**
+ * @param paired
+ * @return Two-sided p-value of "both policies score the same on average" (normal approximation).
+ */
+double pairedPValue(const PairedStats *paired) {
+    double error = pairedStandardError(paired);
+    if (error == 0)
+        return (paired->mean[2] == 0) ? 1.0 : 0.0;
+    return erfc(fabs(paired->mean[2]) / error / sqrt(2.0));
+}
+
+/**
+ * @param alpha
+ * @return z such that a standard normal value falls outside [-z, z] with chance <i>alpha</i>.
+ */
+double normalQuantile(double alpha) {
+    double low = 0;
+    double high = 40;
+
+    for (int i = 0; i < 100; i++) {
+        double middle = (low + high) / 2;
+        if (erfc(middle / sqrt(2.0)) > alpha)
+            low = middle;
+        else
+            high = middle;
+    }
+    return (low + high) / 2;
+}
+
+/**
+ * O'Brien-Fleming type alpha spending function (Lan and DeMets): how much of the significance level a sequential
+ * test may have used up once <i>fraction</i> of its games are in. Next to nothing is spent on early looks, so the
+ * last look is tested at almost the full level.
+ * @param alpha Significance level of the whole test.
+ * @param fraction Share of the planned games played, 0 to 1.
+ * @return Significance level spent so far, <i>alpha</i> at 1.
+ */
+double spentAlpha(double alpha, double fraction) {
+    if (fraction <= 0)
+        return 0;
+    if (fraction >= 1)
+        return alpha;
+    return erfc(normalQuantile(alpha) / sqrt(fraction) / sqrt(2.0));
+}
+
+/**
+ * Unpaired games would need this many times as many games for the same precision.
+ */
+static double pairingGain(const PairedStats *paired) {
+    double pairedVariance = variance(paired, 2);
+    return (pairedVariance > 0) ? (variance(paired, 0) + variance(paired, 1)) / pairedVariance : 0;
+}
+
+/**
+ * Writes the comparison as a JSON object.
+ * @param out
+ * @param paired
+ * @param alpha Significance level of the reported confidence interval.
+ */
+void writePairedJson(FILE *out, const PairedStats *paired, double alpha) {
+    double margin = normalQuantile(alpha) * pairedStandardError(paired);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"pairs\": %llu,\n", (unsigned long long) paired->count);
+    fprintf(out, "  \"mean_a\": %.3f,\n", paired->mean[0]);
+    fprintf(out, "  \"mean_b\": %.3f,\n", paired->mean[1]);
+    fprintf(out, "  \"mean_difference\": %.3f,\n", paired->mean[2]);
+    fprintf(out, "  \"difference_stddev\": %.3f,\n", sqrt(variance(paired, 2)));
+    fprintf(out, "  \"confidence\": %.4f,\n", 1.0 - alpha);
+    fprintf(out, "  \"significance_level\": %.6g,\n", alpha);
+    fprintf(out, "  \"interval\": [%.3f, %.3f],\n", paired->mean[2] - margin, paired->mean[2] + margin);
+    fprintf(out, "  \"p_value\": %.6g,\n", pairedPValue(paired));
+    fprintf(out, "  \"pairing_gain\": %.3f\n", pairingGain(paired));
+    fprintf(out, "}\n");
+}
+
+/**
+ * Writes the comparison as "metric,value" CSV rows.
+ * @param out
+ * @param paired
+ * @param alpha Significance level of the reported confidence interval.
+ */
+void writePairedCsv(FILE *out, const PairedStats *paired, double alpha) {
+    double margin = normalQuantile(alpha) * pairedStandardError(paired);
+
+    fprintf(out, "metric,value\n");
+    fprintf(out, "pairs,%llu\n", (unsigned long long) paired->count);
+    fprintf(out, "mean_a,%.3f\n", paired->mean[0]);
+    fprintf(out, "mean_b,%.3f\n", paired->mean[1]);
+    fprintf(out, "mean_difference,%.3f\n", paired->mean[2]);
+    fprintf(out, "difference_stddev,%.3f\n", sqrt(variance(paired, 2)));
+    fprintf(out, "confidence,%.4f\n", 1.0 - alpha);
+    fprintf(out, "significance_level,%.6g\n", alpha);
+    fprintf(out, "interval_low,%.3f\n", paired->mean[2] - margin);
+    fprintf(out, "interval_high,%.3f\n", paired->mean[2] + margin);
+    fprintf(out, "p_value,%.6g\n", pairedPValue(paired));
+    fprintf(out, "pairing_gain,%.3f\n", pairingGain(paired));
+}
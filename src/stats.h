@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "policy.h"
+
+#ifndef NC2048_STATS_H
+#define NC2048_STATS_H
+
+/*  Quantile sketch resolution: bucket 0 holds zeros, bucket 1 values in (0, 1] and bucket i > 1 values in
+ *  (SKETCH_GAMMA^(i-2), SKETCH_GAMMA^(i-1)], which keeps every reported quantile of 0 or at least 1 within 1% of
+ *  the true value. Values below 1 are only kept apart from 0 and 1, the scores, lengths and speeds sketched here
+ *  are never that small. 2048 buckets reach past 10^17.  */
+#define SKETCH_GAMMA 1.02
+#define SKETCH_BUCKETS 2048
+/*  Max block histogram size, indexed by block exponent.  */
+#define TILE_BUCKETS 32
+
+/*  Fixed size, mergeable quantile sketch of non-negative values.  */
+typedef struct {
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+    uint64_t buckets[SKETCH_BUCKETS];
+} Sketch;
+
+/*  Statistics over any number of games. Its size doesn't depend on the number of games added.  */
+typedef struct {
+    uint64_t games;
+    uint64_t moves;
+    double seconds;             /*  Time spent in games, summed over threads.  */
+    Sketch score;
+    Sketch length;
+    Sketch speed;               /*  Moves per second of each game.             */
+    uint64_t maxTiles[TILE_BUCKETS];
+} Stats;
+
+/*  Running means and variances of two policies' scores on the same games, and of their differences.  */
+typedef struct {
+    uint64_t count;
+    double mean[3];             /*  Policy A, policy B, A - B.  */
+    double m2[3];               /*  Sums of squared deviations from the means.  */
+} PairedStats;
+
+extern void initStats(Stats *stats);
+
+extern void addGame(Stats *stats, const GameResult *game);
+
+extern void mergeStats(Stats *into, const Stats *from);
+
+extern double sketchQuantile(const Sketch *sketch, double quantile);
+
+extern double reachRate(const Stats *stats, int exponent);
+
+extern void writeStatsJson(FILE *out, const Stats *stats, double wallSeconds);
+
+extern void writeStatsCsv(FILE *out, const Stats *stats, double wallSeconds);
+
+extern void initPairedStats(PairedStats *paired);
+
+extern void addPair(PairedStats *paired, double a, double b);
+
+extern void mergePairedStats(PairedStats *into, const PairedStats *from);
+
+extern double pairedStandardError(const PairedStats *paired);
+
+extern double pairedPValue(const PairedStats *paired);
+
+extern double normalQuantile(double alpha);
+
+extern double spentAlpha(double alpha, double fraction);
+
+extern void writePairedJson(FILE *out, const PairedStats *paired, double alpha);
+
+extern void writePairedCsv(FILE *out, const PairedStats *paired, double alpha);
+
+#endif //NC2048_STATS_H
@@ -0,0 +1,622 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tablebase.h"
+
+/*  Number of states a worker claims at once.  */
+#define CHUNK_SIZE 4096
+/*  Stored move of states without a legal move.  */
+#define NO_MOVE 0xFF
+
+/*
+ * The solver is retrograde over layers. Every move + spawn grows the tile sum by exactly 2 or 4, so all
+ * states with tile sum 2 * i form layer i and only depend on layers i + 1 and i + 2:
+ *  - Forward pass: enumerate the reachable canonical states layer by layer, starting at the initial boards.
+ *  - Backward pass: solve the layers from the highest tile sum down, writing every finished layer straight
+ *    into the memory mapped table and releasing layers that are no longer needed.
+ * Both passes split each layer over the worker threads.
+ */
+
+typedef struct {
+    Board *data;
+    size_t count;
+    size_t capacity;
+    size_t compacted;       /*  Count after the last compaction.      */
+    int failed;             /*  Set when an allocation failed.        */
+} StateList;
+
+typedef struct {
+    StateList states;       /*  Sorted and unique once the layer has been reached.  */
+    float *win;
+    float *score;
+    uint8_t *move;
+} Layer;
+
+typedef struct Solver Solver;
+typedef void (*ChunkFunction)(Solver *solver, int worker, size_t begin, size_t end);
+
+struct Solver {
+    int size;
+    int target;
+    int threads;
+
+    Layer *layers;
+    size_t layerCount;
+
+    /*  Per worker spill lists for the +2 and +4 children of the forward pass.  */
+    StateList (*spill)[2];
+
+    /*  Layer being processed and the next unclaimed state in it.  */
+    size_t layer;
+    size_t next;
+    size_t count;
+    ChunkFunction function;
+
+    TableHeader *header;
+    TableEntry *slots;
+};
+
+typedef struct {
+    Solver *solver;
+    int worker;
+} Worker;
+
+/*  Chance of a spawn being a 2 (exponent 1) or a 4 (exponent 2), matching populateRandomBlock().  */
+static const double spawnChance[3] = {
+        0.0,
+        (double) SPAWN_FOUR_ODDS / (SPAWN_FOUR_ODDS + 1),
+        1.0 / (SPAWN_FOUR_ODDS + 1)
+};
+
+static uint64_t hashBoard(Board board) {
+    board ^= board >> 33;
+    board *= 0xFF51AFD7ED558CCDULL;
+    board ^= board >> 33;
+    board *= 0xC4CEB9FE1A85EC53ULL;
+    board ^= board >> 33;
+    return board;
+}
+
+static int pushState(StateList *list, Board board) {
+    if (list->count == list->capacity) {
+        size_t capacity = (list->capacity == 0) ? 1024 : list->capacity * 2;
+        Board *data = realloc(list->data, capacity * sizeof(Board));
+        if (data == NULL) {
+            list->failed = true;
+            return -1;
+        }
+        list->data = data;
+        list->capacity = capacity;
+    }
+    list->data[list->count++] = board;
+    return 0;
+}
+
+static void freeStates(StateList *list) {
+    free(list->data);
+    list->data = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    list->compacted = 0;
+}
+
+static int compareBoards(const void *a, const void *b) {
+    Board left = *(const Board *) a;
+    Board right = *(const Board *) b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * Sorts the list and drops duplicates.
+ */
+static void compactStates(StateList *list) {
+    if (list->count == 0)
+        return;
+
+    qsort(list->data, list->count, sizeof(Board), compareBoards);
+
+    size_t unique = 1;
+    for (size_t i = 1; i < list->count; i++)
+        if (list->data[i] != list->data[unique - 1])
+            list->data[unique++] = list->data[i];
+    list->count = unique;
+    list->compacted = unique;
+}
+
+/**
+ * Appends <i>from</i> to <i>to</i>, compacting <i>to</i> whenever duplicates may have doubled it.
+ */
+static int mergeStates(StateList *to, StateList *from) {
+    for (size_t i = 0; i < from->count; i++)
+        if (pushState(to, from->data[i]) != 0)
+            return -1;
+    from->count = 0;
+
+    if (to->count > 2 * to->compacted + CHUNK_SIZE)
+        compactStates(to);
+    return 0;
+}
+
+static size_t findState(const StateList *list, Board board) {
+    size_t low = 0;
+    size_t high = list->count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (list->data[mid] < board)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+static int ensureLayer(Solver *solver, size_t index) {
+    if (index < solver->layerCount)
+        return 0;
+
+    size_t count = index + 1;
+    Layer *layers = realloc(solver->layers, count * sizeof(Layer));
+    if (layers == NULL)
+        return -1;
+    memset(layers + solver->layerCount, 0, (count - solver->layerCount) * sizeof(Layer));
+    solver->layers = layers;
+    solver->layerCount = count;
+    return 0;
+}
+
+static void freeLayer(Layer *layer) {
+    freeStates(&layer->states);
+    free(layer->win);
+    free(layer->score);
+    free(layer->move);
+    layer->win = NULL;
+    layer->score = NULL;
+    layer->move = NULL;
+}
+
+static int isTerminal(const Solver *solver, Board board) {
+    return solver->target != 0 && boardMaxExponent(board) >= solver->target;
+}
+
+static void *runWorker(void *arg) {
+    Worker *worker = arg;
+    Solver *solver = worker->solver;
+
+    initBoardTables();
+    for (;;) {
+        size_t begin = __atomic_fetch_add(&solver->next, CHUNK_SIZE, __ATOMIC_RELAXED);
+        if (begin >= solver->count)
+            break;
+
+        size_t end = begin + CHUNK_SIZE;
+        if (end > solver->count)
+            end = solver->count;
+        solver->function(solver, worker->worker, begin, end);
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs <i>function</i> over all states of the current layer, split over the worker threads.
+ */
+static void runLayer(Solver *solver, ChunkFunction function) {
+    pthread_t threads[solver->threads];
+    Worker workers[solver->threads];
+
+    solver->next = 0;
+    solver->count = solver->layers[solver->layer].states.count;
+    solver->function = function;
+
+    for (int i = 0; i < solver->threads; i++) {
+        workers[i].solver = solver;
+        workers[i].worker = i;
+        if (i > 0)
+            pthread_create(&threads[i], NULL, runWorker, &workers[i]);
+    }
+
+    /*  The calling thread works as well.  */
+    runWorker(&workers[0]);
+
+    for (int i = 1; i < solver->threads; i++)
+        pthread_join(threads[i], NULL);
+}
+
+static void expandChunk(Solver *solver, int worker, size_t begin, size_t end) {
+    const Board *states = solver->layers[solver->layer].states.data;
+    int size = solver->size;
+
+    for (size_t i = begin; i < end; i++) {
+        Board board = states[i];
+        if (isTerminal(solver, board))
+            continue;
+
+        for (int dir = 0; dir < DIR_COUNT; dir++) {
+            Board moved = boardMoveSized(board, dir, size, NULL);
+            if (moved == board)
+                continue;
+
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    if (boardCell(moved, y, x) != 0)
+                        continue;
+
+                    for (int value = 1; value <= 2; value++) {
+                        Board child = boardCanonical(moved | ((Board) value << boardShift(y, x)), size, NULL);
+                        // A failed push marks the spill list, enumerateStates() checks for it.
+                        pushState(&solver->spill[worker][value - 1], child);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void solveChunk(Solver *solver, int worker, size_t begin, size_t end) {
+    Layer *layer = &solver->layers[solver->layer];
+    int size = solver->size;
+    (void) worker;
+
+    for (size_t i = begin; i < end; i++) {
+        Board board = layer->states.data[i];
+
+        if (isTerminal(solver, board)) {
+            layer->win[i] = 1.0f;
+            layer->score[i] = 0.0f;
+            layer->move[i] = NO_MOVE;
+            continue;
+        }
+
+        double bestWin = 0.0;
+        double bestScore = 0.0;
+        int bestMove = NO_MOVE;
+
+        for (int dir = 0; dir < DIR_COUNT; dir++) {
+            int gained;
+            Board moved = boardMoveSized(board, dir, size, &gained);
+            if (moved == board)
+                continue;
+
+            double empty = boardEmptyCount(moved, size);
+            double win = 0.0;
+            double score = 0.0;
+
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    if (boardCell(moved, y, x) != 0)
+                        continue;
+
+                    for (int value = 1; value <= 2; value++) {
+                        Board child = boardCanonical(moved | ((Board) value << boardShift(y, x)), size, NULL);
+                        Layer *childLayer = &solver->layers[solver->layer + value];
+                        size_t index = findState(&childLayer->states, child);
+                        double chance = spawnChance[value] / empty;
+
+                        win += chance * childLayer->win[index];
+                        score += chance * childLayer->score[index];
+                    }
+                }
+            }
+            score += gained;
+
+            // Maximise the win probability when there is a target, the expected score otherwise.
+            int better;
+            if (bestMove == NO_MOVE)
+                better = true;
+            else if (solver->target != 0 && win != bestWin)
+                better = win > bestWin;
+            else
+                better = score > bestScore;
+
+            if (better) {
+                bestWin = win;
+                bestScore = score;
+                bestMove = dir;
+            }
+        }
+
+        layer->win[i] = (float) bestWin;
+        layer->score[i] = (float) bestScore;
+        layer->move[i] = (uint8_t) bestMove;
+    }
+}
+
+/**
+ * Stores all states of a solved layer in the table.
+ */
+static void writeLayer(Solver *solver, const Layer *layer) {
+    uint64_t mask = solver->header->slotCount - 1;
+
+    for (size_t i = 0; i < layer->states.count; i++) {
+        Board board = layer->states.data[i];
+        uint64_t slot = hashBoard(board) & mask;
+
+        while (solver->slots[slot].board != 0)
+            slot = (slot + 1) & mask;
+
+        TableEntry *entry = &solver->slots[slot];
+        entry->board = board;
+        entry->score = layer->score[i];
+        entry->win = (uint16_t) (layer->win[i] * 65535.0f + 0.5f);
+        entry->move = layer->move[i];
+    }
+}
+
+static int seedLayers(Solver *solver) {
+    int cells = solver->size * solver->size;
+
+    for (int first = 0; first < cells; first++) {
+        for (int second = first + 1; second < cells; second++) {
+            for (int a = 1; a <= 2; a++) {
+                for (int b = 1; b <= 2; b++) {
+                    Board board = ((Board) a << boardShift(first / solver->size, first % solver->size))
+                                  | ((Board) b << boardShift(second / solver->size, second % solver->size));
+                    size_t index = (size_t) boardTileSum(board) / 2;
+
+                    if (ensureLayer(solver, index) != 0
+                        || pushState(&solver->layers[index].states, boardCanonical(board, solver->size, NULL)) != 0)
+                        return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int enumerateStates(Solver *solver, uint64_t *total) {
+    *total = 0;
+
+    for (size_t index = 0; index < solver->layerCount; index++) {
+        Layer *layer = &solver->layers[index];
+        compactStates(&layer->states);
+        if (layer->states.count == 0)
+            continue;
+
+        solver->layer = index;
+        runLayer(solver, expandChunk);
+
+        if (ensureLayer(solver, index + 2) != 0)
+            return -1;
+        for (int i = 0; i < solver->threads; i++) {
+            for (int value = 1; value <= 2; value++) {
+                StateList *spill = &solver->spill[i][value - 1];
+                if (spill->failed)
+                    return -1;
+                if (mergeStates(&solver->layers[index + value].states, spill) != 0)
+                    return -1;
+            }
+        }
+
+        *total += solver->layers[index].states.count;
+        fprintf(stderr, "forward: tile sum %zu, %zu states\n", index * 2, solver->layers[index].states.count);
+    }
+
+    return 0;
+}
+
+static int solveStates(Solver *solver) {
+    for (size_t index = solver->layerCount; index-- > 0;) {
+        Layer *layer = &solver->layers[index];
+
+        if (layer->states.count > 0) {
+            size_t count = layer->states.count;
+            layer->win = malloc(count * sizeof(float));
+            layer->score = malloc(count * sizeof(float));
+            layer->move = malloc(count);
+            if (layer->win == NULL || layer->score == NULL || layer->move == NULL)
+                return -1;
+
+            solver->layer = index;
+            runLayer(solver, solveChunk);
+            writeLayer(solver, layer);
+
+            fprintf(stderr, "backward: tile sum %zu solved\n", index * 2);
+        }
+
+        // Layer index + 2 was only needed by this one.
+        if (index + 2 < solver->layerCount)
+            freeLayer(&solver->layers[index + 2]);
+    }
+
+    return 0;
+}
+
+static int createTable(Solver *solver, const char *path, uint64_t states, int *fd, size_t *mappedSize) {
+    uint64_t slotCount = 1;
+    while (slotCount < states + states / 3 + 1)
+        slotCount <<= 1;
+
+    *mappedSize = sizeof(TableHeader) + slotCount * sizeof(TableEntry);
+    *fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (*fd < 0)
+        return -1;
+    if (ftruncate(*fd, (off_t) *mappedSize) != 0)
+        return -1;
+
+    void *mapped = mmap(NULL, *mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    if (mapped == MAP_FAILED)
+        return -1;
+
+    solver->header = mapped;
+    solver->slots = (TableEntry *) (solver->header + 1);
+
+    memcpy(solver->header->magic, TABLEBASE_MAGIC, sizeof(solver->header->magic));
+    solver->header->version = TABLEBASE_VERSION;
+    solver->header->size = (uint32_t) solver->size;
+    solver->header->target = (uint32_t) solver->target;
+    solver->header->states = states;
+    solver->header->slotCount = slotCount;
+    return 0;
+}
+
+/**
+ * Solves every reachable state of a <i>size</i> x <i>size</i> game and writes the results to a table at
+ * <i>path</i>. Progress is reported on stderr.
+ * @param path Output file, replaced if it exists.
+ * @param size Board side length, 2 to BOARD_MAX_SIZE. 4x4 is only feasible with a small target.
+ * @param target Block exponent that wins and ends the game, 0 to play every game until it is lost.
+ * @param threads Number of worker threads, 0 to use every online CPU.
+ * @return 0 on success, -1 on failure with errno set.
+ */
+int solveTablebase(const char *path, int size, int target, int threads) {
+    if (size < 2 || size > BOARD_MAX_SIZE || target < 0 || target > BOARD_MAX_EXPONENT) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    initBoardTables();
+    errno = 0;
+
+    Solver solver;
+    memset(&solver, 0, sizeof(solver));
+    solver.size = size;
+    solver.target = target;
+    solver.threads = (threads > 0) ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (solver.threads < 1)
+        solver.threads = 1;
+
+    int fd = -1;
+    size_t mappedSize = 0;
+    uint64_t states;
+    int result = -1;
+
+    solver.spill = calloc((size_t) solver.threads, sizeof(*solver.spill));
+    if (solver.spill == NULL)
+        goto out;
+
+    if (seedLayers(&solver) != 0 || enumerateStates(&solver, &states) != 0)
+        goto out;
+    fprintf(stderr, "%llu reachable states\n", (unsigned long long) states);
+
+    if (createTable(&solver, path, states, &fd, &mappedSize) != 0 || solveStates(&solver) != 0)
+        goto out;
+
+    result = 0;
+
+    out:
+    if (result != 0 && errno == 0)
+        errno = ENOMEM;
+    int error = errno;
+
+    if (solver.header != NULL) {
+        msync(solver.header, mappedSize, MS_SYNC);
+        munmap(solver.header, mappedSize);
+    }
+    if (fd >= 0)
+        close(fd);
+    for (size_t i = 0; i < solver.layerCount; i++)
+        freeLayer(&solver.layers[i]);
+    free(solver.layers);
+    if (solver.spill != NULL) {
+        for (int i = 0; i < solver.threads; i++) {
+            freeStates(&solver.spill[i][0]);
+            freeStates(&solver.spill[i][1]);
+        }
+        free(solver.spill);
+    }
+
+    errno = error;
+    return result;
+}
+
+/**
+ * Maps a table written by solveTablebase() into memory.
+ * @param path
+ * @return The opened table, or NULL on failure with errno set.
+ */
+Tablebase *openTablebase(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(TableHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t mappedSize = (size_t) info.st_size;
+    void *mapped = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    TableHeader *header = mapped;
+    if (memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != TABLEBASE_VERSION
+        || header->size < 2 || header->size > BOARD_MAX_SIZE
+        || header->slotCount == 0
+        || (header->slotCount & (header->slotCount - 1)) != 0
+        || header->slotCount > (mappedSize - sizeof(TableHeader)) / sizeof(TableEntry)) {
+        munmap(mapped, mappedSize);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Probes jump around the whole table, read-ahead would only waste page cache.
+    madvise(mapped, mappedSize, MADV_RANDOM);
+
+    Tablebase *table = malloc(sizeof(Tablebase));
+    if (table == NULL) {
+        munmap(mapped, mappedSize);
+        return NULL;
+    }
+    table->header = header;
+    table->slots = (TableEntry *) (header + 1);
+    table->mappedSize = mappedSize;
+    return table;
+}
+
+/**
+ * Unmaps and frees a table. Accepts NULL.
+ * @param table
+ */
+void closeTablebase(Tablebase *table) {
+    if (table == NULL)
+        return;
+    munmap(table->header, table->mappedSize);
+    free(table);
+}
+
+/**
+ * Looks up the perfect play values of a board.
+ * @param table
+ * @param board Board of the table's size, in any orientation.
+ * @param result Receives the best move (for <i>board</i> itself), win probability and expected score.
+ * @return true(1) if the board was found, false(0) if it is not reachable on this table.
+ */
+int probeTablebase(const Tablebase *table, Board board, TableResult *result) {
+    int symmetry;
+    Board canonical = boardCanonical(board, (int) table->header->size, &symmetry);
+    uint64_t mask = table->header->slotCount - 1;
+    uint64_t slot = hashBoard(canonical) & mask;
+
+    for (;;) {
+        const TableEntry *entry = &table->slots[slot];
+        if (entry->board == 0)
+            return false;
+
+        if (entry->board == canonical) {
+            result->move = DIR_NONE;
+            // The stored move belongs to the canonical board, map it back onto ours.
+            for (int dir = 0; dir < DIR_COUNT && entry->move != NO_MOVE; dir++)
+                if (dirSymmetry(dir, symmetry) == entry->move)
+                    result->move = dir;
+            result->win = entry->win / 65535.0;
+            result->score = entry->score;
+            return true;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+}
@@ -0,0 +1,52 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "board.h"
+
+#ifndef NC2048_TABLEBASE_H
+#define NC2048_TABLEBASE_H
+
+/*  On-disk table layout: a TableHeader followed by <i>slotCount</i> TableEntry slots, forming an open
+ *  addressing hash table (linear probing) keyed by the canonical board.  */
+#define TABLEBASE_MAGIC "NC2048TB"
+#define TABLEBASE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;          /*  Board side length.                                  */
+    uint32_t target;        /*  Winning block exponent, 0 if the game is played out. */
+    uint32_t reserved;
+    uint64_t states;        /*  Number of stored canonical states.                  */
+    uint64_t slotCount;     /*  Number of slots, always a power of two.             */
+} TableHeader;
+
+typedef struct {
+    uint64_t board;         /*  Canonical board, 0 marks an empty slot.                  */
+    float score;            /*  Expected score still to be gained with perfect play.     */
+    uint16_t win;           /*  Win probability with perfect play, scaled to 0..65535.   */
+    uint8_t move;           /*  Best move of the canonical board, one of the DIR_* values. */
+    uint8_t flags;
+} TableEntry;
+
+typedef struct {
+    TableHeader *header;
+    TableEntry *slots;
+    size_t mappedSize;
+} Tablebase;
+
+typedef struct {
+    int move;               /*  Best move for the probed board (not the canonical one). */
+    double win;
+    double score;
+} TableResult;
+
+extern int solveTablebase(const char *path, int size, int target, int threads);
+
+extern Tablebase *openTablebase(const char *path);
+
+extern void closeTablebase(Tablebase *table);
+
+extern int probeTablebase(const Tablebase *table, Board board, TableResult *result);
+
+#endif //NC2048_TABLEBASE_H